@@ -0,0 +1,229 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+
+// aggressive dead code elimination: only instructions with side
+// effects are assumed live, liveness flows to the definitions of the
+// operands they use and to the branches they are control dependent
+// on, and everything else is removed; a dead branch jumps to the
+// nearest postdominator that does something
+
+typedef struct {
+    int nr_node;
+    IRNode **nodes;
+    int *block_of;
+    bool *live;
+    int *worklist;
+    int nr_work;
+    int *nr_cd;
+    Block ***cd;  // the blocks whose branch decides if a block runs
+} Adce;
+
+static int nr_removed;
+
+static bool is_root(IR *ir) {
+    if (ir->kind == IR_WRITE
+            || ir->kind == IR_RETURN
+            || ir->kind == IR_CALL
+            || ir->kind == IR_READ
+            || ir->kind == IR_ARG
+            || ir->kind == IR_PARAM
+            || ir->kind == IR_ALLOC) {
+        return true;
+    }
+    if (ir_store(ir) != NULL) {
+        return true;
+    }
+    Operand *def = ir_def(ir);
+    return def != NULL && def->kind == VAR_OPERAND && is_global(def->var_name);
+}
+
+static int node_index(Adce *a, IRNode *q) {
+    for (int i = 0; i < a->nr_node; i++) {
+        if (a->nodes[i] == q) {
+            return i;
+        }
+    }
+    fatal("node is not in the function");
+}
+
+static void mark(Adce *a, int i) {
+    if (!a->live[i]) {
+        a->live[i] = true;
+        a->worklist[a->nr_work++] = i;
+    }
+}
+
+static void mark_defs(Adce *a, Operand *op) {
+    if (op->kind == INDIR) {
+        mark_defs(a, op->indir_var);
+        return;
+    }
+    if (op->kind != TEMP && op->kind != VAR_OPERAND) {
+        return;
+    }
+    for (int i = 0; i < a->nr_node; i++) {
+        Operand *def = ir_def(a->nodes[i]->ir);
+        if (def != NULL && op_equals(def, op)) {
+            mark(a, i);
+        }
+    }
+}
+
+static void propagate(Adce *a) {
+    while (a->nr_work > 0) {
+        int i = a->worklist[--a->nr_work];
+        IR *ir = a->nodes[i]->ir;
+        Operand **slots[MAX_READ_SLOT];
+        int n = ir_read_slots(ir, slots);
+        for (int k = 0; k < n; k++) {
+            mark_defs(a, *slots[k]);
+        }
+        if (ir_store(ir) != NULL) {
+            mark_defs(a, ir_store(ir));
+        }
+        int b = a->block_of[i];
+        for (int k = 0; k < a->nr_cd[b]; k++) {
+            mark(a, node_index(a, a->cd[b][k]->last));
+        }
+    }
+}
+
+static void add_cd(Adce *a, Block *b, Block *on) {
+    int n = a->nr_cd[b->id];
+    for (int k = 0; k < n; k++) {
+        if (a->cd[b->id][k] == on) {
+            return;
+        }
+    }
+    a->cd[b->id] = realloc(a->cd[b->id], (n + 1) * sizeof(Block *));
+    a->cd[b->id][n] = on;
+    a->nr_cd[b->id]++;
+}
+
+// b is control dependent on the branch of x if b postdominates a
+// successor of x but does not strictly postdominate x
+static void control_dependence(Adce *a, CFG *cfg) {
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *x = cfg->blocks[i];
+        if (x->nr_succ < 2 || !x->reaches_exit) {
+            continue;
+        }
+        for (int k = 0; k < x->nr_succ; k++) {
+            Block *runner = x->succ[k];
+            while (runner != NULL && runner != x->ipdom) {
+                add_cd(a, runner, x);
+                if (!runner->reaches_exit) {
+                    break;
+                }
+                runner = runner->ipdom;
+            }
+        }
+    }
+}
+
+static bool is_useful(Adce *a, Block *b) {
+    for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+        // labels may have been added by block_label
+        if (q->ir->kind != IR_LABEL && a->live[node_index(a, q)]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Block *useful_postdominator(Adce *a, Block *b) {
+    Block *runner = b->ipdom;
+    while (runner != NULL && !is_useful(a, runner)) {
+        runner = runner->ipdom;
+    }
+    return runner;
+}
+
+static void eliminate_function_dead_code(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    compute_postdominators(cfg);
+
+    Adce *a = malloc(sizeof(Adce));
+    a->nr_node = 0;
+    for (IRNode *q = func->next; q != cfg->end; q = q->next) {
+        a->nr_node++;
+    }
+    int n = a->nr_node + 1;
+    a->nodes = malloc(n * sizeof(IRNode *));
+    a->block_of = malloc(n * sizeof(int));
+    a->live = malloc(n * sizeof(bool));
+    a->worklist = malloc(n * sizeof(int));
+    a->nr_work = 0;
+    a->nr_cd = malloc((cfg->nr_block + 1) * sizeof(int));
+    a->cd = malloc((cfg->nr_block + 1) * sizeof(Block **));
+    int i = 0;
+    for (int b = 0; b < cfg->nr_block; b++) {
+        a->nr_cd[b] = 0;
+        a->cd[b] = NULL;
+        Block *block = cfg->blocks[b];
+        for (IRNode *q = block->first; q != block->last->next; q = q->next) {
+            a->nodes[i] = q;
+            a->block_of[i] = b;
+            a->live[i] = false;
+            i++;
+        }
+    }
+    control_dependence(a, cfg);
+
+    for (i = 0; i < a->nr_node; i++) {
+        IR *ir = a->nodes[i]->ir;
+        Block *b = cfg->blocks[a->block_of[i]];
+        if (is_root(ir)
+                || (ir->kind == IR_IF && !b->reaches_exit)) {
+            mark(a, i);
+        }
+    }
+
+    // a dead branch needs a useful postdominator to jump to
+    bool changed = true;
+    while (changed) {
+        propagate(a);
+        changed = false;
+        for (i = 0; i < a->nr_node; i++) {
+            IR *ir = a->nodes[i]->ir;
+            Block *b = cfg->blocks[a->block_of[i]];
+            if (ir->kind == IR_IF && !a->live[i]
+                    && useful_postdominator(a, b) == NULL) {
+                mark(a, i);
+                changed = true;
+            }
+        }
+    }
+
+    // retarget dead branches before anything is removed from the list
+    for (i = 0; i < a->nr_node; i++) {
+        IRNode *q = a->nodes[i];
+        if (q->ir->kind == IR_IF && !a->live[i]) {
+            Block *target = useful_postdominator(a,
+                    cfg->blocks[a->block_of[i]]);
+            info("dead branch: %s", ir_repr(q->ir));
+            q->ir = newGoto(block_label(target));
+            nr_removed++;
+        }
+    }
+    for (i = 0; i < a->nr_node; i++) {
+        IRNode *q = a->nodes[i];
+        IR *ir = q->ir;
+        if (a->live[i] || ir->kind == IR_LABEL || ir->kind == IR_GOTO) {
+            continue;
+        }
+        info("dead IR: %s", ir_repr(ir));
+        IRList_remove(q);
+        nr_removed++;
+    }
+}
+
+void eliminate_dead_code_aggressive() {
+    info("eliminating dead code aggressively...");
+    nr_removed = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        eliminate_function_dead_code(f);
+    }
+    info("%d instructions removed", nr_removed);
+}
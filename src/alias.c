@@ -0,0 +1,303 @@
+#include "alias.h"
+#include "st.h"
+
+extern IRList irList;
+extern int nr_temp;
+
+// what an address operand may point into
+typedef struct {
+    enum { PT_NONE, PT_SITE, PT_ANY } kind;
+    // for PT_SITE
+    enum { SITE_ALLOC, SITE_PARAM } site;
+    int alloc_no;  // temp declared by the DEC
+    char *param;   // array parameter
+    bool offset_known;
+    int offset;
+} PointsTo;
+
+typedef struct VarPointsTo_ {
+    char *name;
+    PointsTo pt;
+    struct VarPointsTo_ *next;
+} VarPointsTo;
+
+static int nr_analyzed_temp = 0;
+static PointsTo *temp_pt = NULL;
+static VarPointsTo *var_pt = NULL;
+static bool *escaped = NULL;  // indexed by the temp of a DEC
+
+static PointsTo pt_none() {
+    PointsTo pt;
+    memset(&pt, 0, sizeof(PointsTo));
+    pt.kind = PT_NONE;
+    return pt;
+}
+
+static PointsTo pt_any() {
+    PointsTo pt = pt_none();
+    pt.kind = PT_ANY;
+    return pt;
+}
+
+static PointsTo pt_alloc(int alloc_no) {
+    PointsTo pt = pt_none();
+    pt.kind = PT_SITE;
+    pt.site = SITE_ALLOC;
+    pt.alloc_no = alloc_no;
+    pt.offset_known = true;
+    pt.offset = 0;
+    return pt;
+}
+
+static PointsTo pt_param(char *name) {
+    PointsTo pt = pt_none();
+    pt.kind = PT_SITE;
+    pt.site = SITE_PARAM;
+    pt.param = name;
+    pt.offset_known = true;
+    pt.offset = 0;
+    return pt;
+}
+
+static bool is_array_var(char *name) {
+    return contains_variable(name)
+        && isArrayType(retrieve_variable_type(name));
+}
+
+static PointsTo *lookup(Operand *op) {
+    if (op->kind == TEMP) {
+        if (op->temp_no > nr_analyzed_temp) {
+            return NULL;
+        }
+        return &temp_pt[op->temp_no];
+    } else if (op->kind == VAR_OPERAND) {
+        for (VarPointsTo *v = var_pt; v != NULL; v = v->next) {
+            if (strcmp(v->name, op->var_name) == 0) {
+                return &v->pt;
+            }
+        }
+        VarPointsTo *v = malloc(sizeof(VarPointsTo));
+        v->name = op->var_name;
+        v->pt = pt_none();
+        v->next = var_pt;
+        var_pt = v;
+        return &v->pt;
+    } else {
+        return NULL;
+    }
+}
+
+static PointsTo pt_of(Operand *op) {
+    if (op->kind == ADDR && op->addr_var->kind == TEMP) {
+        return pt_alloc(op->addr_var->temp_no);
+    }
+    if (op->kind != TEMP && op->kind != VAR_OPERAND) {
+        // literals and values loaded from memory are not addresses
+        return pt_none();
+    }
+    PointsTo *pt = lookup(op);
+    if (pt == NULL) {
+        return pt_any();
+    }
+    return *pt;
+}
+
+static bool same_site(PointsTo *a, PointsTo *b) {
+    if (a->site != b->site) {
+        return false;
+    }
+    if (a->site == SITE_ALLOC) {
+        return a->alloc_no == b->alloc_no;
+    } else {
+        return strcmp(a->param, b->param) == 0;
+    }
+}
+
+static bool meet_into(PointsTo *dst, PointsTo src) {
+    if (dst == NULL || src.kind == PT_NONE || dst->kind == PT_ANY) {
+        return false;
+    }
+    if (dst->kind == PT_NONE || src.kind == PT_ANY) {
+        *dst = src;
+        return true;
+    }
+    if (!same_site(dst, &src)) {
+        *dst = pt_any();
+        return true;
+    }
+    if (dst->offset_known
+            && (!src.offset_known || src.offset != dst->offset)) {
+        dst->offset_known = false;
+        return true;
+    }
+    return false;
+}
+
+// pointer arithmetic: a site plus or minus an integer
+static PointsTo pt_offset(PointsTo base, Operand *delta, int sign) {
+    if (base.offset_known && delta->kind == INT_LITERAL) {
+        base.offset += sign * delta->int_value;
+    } else {
+        base.offset_known = false;
+    }
+    return base;
+}
+
+static PointsTo transfer(IR *ir) {
+    if (ir->kind == IR_ASSIGN) {
+        return pt_of(ir->arg1);
+    } else if (ir->kind == IR_ADD || ir->kind == IR_SUB) {
+        PointsTo a = pt_of(ir->arg1);
+        PointsTo b = pt_of(ir->arg2);
+        if (a.kind == PT_NONE && b.kind == PT_NONE) {
+            return pt_none();
+        } else if (a.kind == PT_SITE && b.kind == PT_NONE) {
+            return pt_offset(a, ir->arg2, ir->kind == IR_ADD ? 1 : -1);
+        } else if (a.kind == PT_NONE && b.kind == PT_SITE
+                && ir->kind == IR_ADD) {
+            return pt_offset(b, ir->arg1, 1);
+        } else {
+            return pt_any();
+        }
+    } else if (ir->kind == IR_MUL || ir->kind == IR_DIV) {
+        if (pt_of(ir->arg1).kind == PT_NONE
+                && pt_of(ir->arg2).kind == PT_NONE) {
+            return pt_none();
+        }
+        return pt_any();
+    } else if (ir->kind == IR_PARAM) {
+        if (is_array_var(ir->arg1->var_name)) {
+            return pt_param(ir->arg1->var_name);
+        }
+        return pt_none();
+    } else {
+        return pt_none();
+    }
+}
+
+static void mark_escaped(PointsTo pt) {
+    if (pt.kind == PT_ANY) {
+        for (int i = 0; i <= nr_analyzed_temp; i++) {
+            escaped[i] = true;
+        }
+    } else if (pt.kind == PT_SITE && pt.site == SITE_ALLOC
+            && pt.alloc_no <= nr_analyzed_temp) {
+        escaped[pt.alloc_no] = true;
+    }
+}
+
+// flow-insensitive points-to over the whole program: temps and
+// variable names are unique, so one fact per operand is enough
+void alias_analyze() {
+    nr_analyzed_temp = nr_temp;
+    temp_pt = realloc(temp_pt, (nr_temp + 1) * sizeof(PointsTo));
+    escaped = realloc(escaped, (nr_temp + 1) * sizeof(bool));
+    for (int i = 0; i <= nr_temp; i++) {
+        temp_pt[i] = pt_none();
+        escaped[i] = false;
+    }
+    var_pt = NULL;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (IRNode *q = irList.head; q != NULL; q = q->next) {
+            Operand *def = ir_def(q->ir);
+            if (def != NULL && meet_into(lookup(def), transfer(q->ir))) {
+                changed = true;
+            }
+        }
+    }
+
+    // a callee can reach arrays passed to it and global arrays
+    bool in_function = false;
+    for (IRNode *q = irList.head; q != NULL; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_FUNCTION) {
+            in_function = true;
+        } else if (ir->kind == IR_ARG) {
+            mark_escaped(pt_of(ir->arg1));
+        } else if (ir->kind == IR_ALLOC && !in_function) {
+            mark_escaped(pt_alloc(ir->alloc.var->temp_no));
+        }
+    }
+}
+
+// p and q are address operands, e.g. the operands of `*p' and `*q'
+bool may_alias(Operand *p, Operand *q) {
+    PointsTo a = pt_of(p);
+    PointsTo b = pt_of(q);
+    if (a.kind != PT_SITE || b.kind != PT_SITE) {
+        return true;
+    }
+    if (a.site == SITE_ALLOC && b.site == SITE_ALLOC) {
+        if (a.alloc_no != b.alloc_no) {
+            return false;
+        }
+        return !a.offset_known || !b.offset_known || a.offset == b.offset;
+    }
+    if (a.site == SITE_ALLOC) {
+        return escaped[a.alloc_no];
+    }
+    if (b.site == SITE_ALLOC) {
+        return escaped[b.alloc_no];
+    }
+    // two array parameters may be the same array
+    return true;
+}
+
+bool must_alias(Operand *p, Operand *q) {
+    PointsTo a = pt_of(p);
+    PointsTo b = pt_of(q);
+    return a.kind == PT_SITE && b.kind == PT_SITE
+        && same_site(&a, &b)
+        && a.offset_known && b.offset_known
+        && a.offset == b.offset;
+}
+
+// may a called function read or write *p
+bool call_may_access(Operand *p) {
+    PointsTo a = pt_of(p);
+    if (a.kind != PT_SITE) {
+        return true;
+    }
+    if (a.site == SITE_PARAM) {
+        return true;
+    }
+    return escaped[a.alloc_no];
+}
+
+// the allocation p points into, 0 if it is not known to be one
+int alloc_of(Operand *p) {
+    PointsTo a = pt_of(p);
+    if (a.kind != PT_SITE || a.site != SITE_ALLOC) {
+        return 0;
+    }
+    return a.alloc_no;
+}
+
+bool alloc_escapes(int alloc_no) {
+    return alloc_no > nr_analyzed_temp || escaped[alloc_no];
+}
+
+// may p point anywhere into the allocation of temp alloc_no
+bool may_point_to(Operand *p, int alloc_no) {
+    PointsTo a = pt_of(p);
+    if (a.kind != PT_SITE) {
+        return true;
+    }
+    if (a.site == SITE_PARAM) {
+        return alloc_escapes(alloc_no);
+    }
+    return a.alloc_no == alloc_no;
+}
+
+// the constant offset of p into what it points to
+bool offset_of(Operand *p, int *offset) {
+    PointsTo a = pt_of(p);
+    if (a.kind != PT_SITE || !a.offset_known) {
+        return false;
+    }
+    *offset = a.offset;
+    return true;
+}
@@ -0,0 +1,16 @@
+#ifndef __ALIAS_H__
+#define __ALIAS_H__
+
+#include "common.h"
+#include "ir.h"
+
+void alias_analyze();
+bool may_alias(Operand *p, Operand *q);
+bool must_alias(Operand *p, Operand *q);
+bool call_may_access(Operand *p);
+int alloc_of(Operand *p);
+bool alloc_escapes(int alloc_no);
+bool may_point_to(Operand *p, int alloc_no);
+bool offset_of(Operand *p, int *offset);
+
+#endif
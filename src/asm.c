@@ -54,8 +54,11 @@ extern FILE *asm_out;
 #define v0 "$v0"
 #define ra "$ra"
 
-int arg_cnt = 0;
 int param_cnt = 0;
+static bool *temp_read;  // by number, whether the value is ever read
+static bool *temp_used;  // by number, whether it is in the code at all
+static int nr_used_var;
+static char **used_vars;
 
 static void load_to(char *reg, Operand *op) {
     if (op->kind == INT_LITERAL) {
@@ -164,17 +167,63 @@ static void translate_alloc(IR *ir) {
 static void translate_arg(IR *ir) {
     load_to(t0, ir->arg1);
     push(t0);
-    arg_cnt++;
+}
+
+static int nr_params_of(char *name) {
+    for (IRNode *q = irList.head; q != NULL; q = q->next) {
+        if (q->ir->kind == IR_FUNCTION
+                && strcmp(q->ir->function.name, name) == 0) {
+            int n = 0;
+            for (q = q->next; q != NULL && q->ir->kind == IR_PARAM;
+                    q = q->next) {
+                n++;
+            }
+            return n;
+        }
+    }
+    return 0;
 }
 
 static void translate_call(IR *ir) {
     push(ra);
     mips("jal func_%s", op_repr(ir->arg1));
     pop(ra);
-    store(v0, ir->result);
-    // remove pushed arguments
-    mips("addi $sp, $sp, %d", 4 * arg_cnt);
-    arg_cnt = 0;
+    if (ir->result->kind != TEMP || temp_read[ir->result->temp_no]) {
+        store(v0, ir->result);
+    }
+    // remove pushed arguments, by the callee as block layout may have
+    // placed some of the pushes after the call
+    mips("addi $sp, $sp, %d", 4 * nr_params_of(op_repr(ir->arg1)));
+}
+
+static bool is_tail_call(IRNode *q) {
+    IR *ir = q->ir;
+    if (ir->kind != IR_CALL || ir->result == NULL || q->next == NULL) {
+        return false;
+    }
+    IR *next = q->next->ir;
+    return next->kind == IR_RETURN && op_equals(next->arg1, ir->result);
+}
+
+// a call whose result is returned at once jumps to the callee, which
+// returns to our caller: the pushed arguments are moved up into our own
+// argument area, so it must be large enough for them
+static bool translate_tail_call(IRNode *q) {
+    if (!is_tail_call(q)) {
+        return false;
+    }
+    int n = nr_params_of(q->ir->arg1->sym_name);
+    if (n > param_cnt) {
+        return false;
+    }
+    // from the last argument, the farthest from the top of the stack
+    for (int i = n; i >= 1; i--) {
+        mips("lw %s, %d($sp)", t0, 4 * (i - 1));
+        mips("sw %s, %d($sp)", t0, 4 * (n + i));
+    }
+    mips("addi $sp, $sp, %d", 4 * n);
+    mips("j func_%s", op_repr(q->ir->arg1));
+    return true;
 }
 
 static void translate_param(IR *ir) {
@@ -202,6 +251,82 @@ static void translate_write(IR *ir) {
     pop(ra);
 }
 
+// set on compare without branching: slt for the orderings, and the
+// xor of the operands compared with zero for equality
+static void translate_cmp(IR *ir) {
+    load_to(t1, ir->arg1);
+    load_to(t2, ir->arg2);
+    if (ir->relop == RELOP_LT) {
+        mips("slt %s, %s, %s", t0, t1, t2);
+    } else if (ir->relop == RELOP_GT) {
+        mips("slt %s, %s, %s", t0, t2, t1);
+    } else if (ir->relop == RELOP_LE) {
+        mips("slt %s, %s, %s", t0, t2, t1);
+        mips("xori %s, %s, 1", t0, t0);
+    } else if (ir->relop == RELOP_GE) {
+        mips("slt %s, %s, %s", t0, t1, t2);
+        mips("xori %s, %s, 1", t0, t0);
+    } else if (ir->relop == RELOP_EQ) {
+        mips("xor %s, %s, %s", t0, t1, t2);
+        mips("sltiu %s, %s, 1", t0, t0);
+    } else {
+        mips("xor %s, %s, %s", t0, t1, t2);
+        mips("sltu %s, $zero, %s", t0, t0);
+    }
+    store(t0, ir->result);
+}
+
+// a select that keeps the old value on one side needs one move only
+static void translate_select(IR *ir) {
+    load_to(t2, ir->cond);
+    if (op_equals(ir->arg2, ir->result)) {
+        load_to(t0, ir->arg2);
+        load_to(t1, ir->arg1);
+        mips("movn %s, %s, %s", t0, t1, t2);
+    } else if (op_equals(ir->arg1, ir->result)) {
+        load_to(t0, ir->arg1);
+        load_to(t1, ir->arg2);
+        mips("movz %s, %s, %s", t0, t1, t2);
+    } else {
+        load_to(t0, ir->arg2);
+        load_to(t1, ir->arg1);
+        mips("movn %s, %s, %s", t0, t1, t2);
+    }
+    store(t0, ir->result);
+}
+
+// a shift by a constant uses the immediate form
+static void translate_shift(IR *ir, char *op) {
+    load_to(t1, ir->arg1);
+    if (ir->arg2->kind == INT_LITERAL) {
+        mips("%s %s, %s, %d", op, t0, t1, ir->arg2->int_value & 31);
+    } else {
+        load_to(t2, ir->arg2);
+        mips("%sv %s, %s, %s", op, t0, t1, t2);
+    }
+    store(t0, ir->result);
+}
+
+static void translate_shl(IR *ir) {
+    translate_shift(ir, "sll");
+}
+
+static void translate_shr(IR *ir) {
+    translate_shift(ir, "sra");
+}
+
+static void translate_shru(IR *ir) {
+    translate_shift(ir, "srl");
+}
+
+static void translate_mulh(IR *ir) {
+    load_to(t1, ir->arg1);
+    load_to(t2, ir->arg2);
+    mips("mult %s, %s", t1, t2);
+    mips("mfhi %s", t0);
+    store(t0, ir->result);
+}
+
 typedef void (*funcptr)(IR *ir);
 
 static funcptr translate_func_table[] = {
@@ -221,19 +346,36 @@ static funcptr translate_func_table[] = {
     translate_param,
     translate_read,
     translate_write,
+    translate_cmp,
+    translate_select,
+    translate_shl,
+    translate_shr,
+    translate_shru,
+    translate_mulh,
 };
 
 static void translate_IR(IR *ir) {
     translate_func_table[ir->kind](ir);
 }
 
+static bool is_used_var(char *name) {
+    for (int i = 0; i < nr_used_var; i++) {
+        if (strcmp(used_vars[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void generate_data() {
     mips0(".data");
 
     SymbolTable *vst = get_current_env()->vst;
     for (SymbolNode *q = vst->head; q != NULL; q = q->next) {
         Symbol *sym = q->symbol;
-        mips0("var_%s: .space 4", sym->name);
+        if (is_used_var(sym->name)) {
+            mips0("var_%s: .space 4", sym->name);
+        }
     }
 
     extern int nr_temp;
@@ -254,7 +396,7 @@ static void generate_data() {
     }
 
     for (int i = 1; i <= nr_temp; i++) {
-        if (shadowed[i]) {
+        if (shadowed[i] || !temp_used[i]) {
             continue;
         }
         mips0("var_t%d: .space 4", i);
@@ -289,11 +431,79 @@ static void generate_func() {
     mips("jr $ra");
 }
 
+static void mark_read(Operand *op) {
+    if (op->kind == TEMP) {
+        temp_read[op->temp_no] = true;
+    } else if (op->kind == ADDR) {
+        mark_read(op->addr_var);
+    } else if (op->kind == INDIR) {
+        mark_read(op->indir_var);
+    }
+}
+
+// a temp or variable that is not in the code gets no storage
+static void mark_used(Operand *op) {
+    if (op == NULL) {
+        return;
+    }
+    if (op->kind == TEMP) {
+        temp_used[op->temp_no] = true;
+    } else if (op->kind == VAR_OPERAND && !is_used_var(op->var_name)) {
+        used_vars = realloc(used_vars, (nr_used_var + 1) * sizeof(char *));
+        used_vars[nr_used_var++] = op->var_name;
+    } else if (op->kind == ADDR) {
+        mark_used(op->addr_var);
+    } else if (op->kind == INDIR) {
+        mark_used(op->indir_var);
+    }
+}
+
+static void find_uses() {
+    extern int nr_temp;
+    temp_read = malloc((nr_temp + 1) * sizeof(bool));
+    temp_used = malloc((nr_temp + 1) * sizeof(bool));
+    for (int i = 0; i <= nr_temp; i++) {
+        temp_read[i] = false;
+        temp_used[i] = false;
+    }
+    nr_used_var = 0;
+    used_vars = NULL;
+    for (IRNode *q = irList.head; q != NULL; q = q->next) {
+        IR *ir = q->ir;
+        Operand **slots[MAX_READ_SLOT];
+        int n = ir_read_slots(ir, slots);
+        for (int i = 0; i < n; i++) {
+            mark_read(*slots[i]);
+            mark_used(*slots[i]);
+        }
+        mark_used(ir_def(ir));
+        if (ir->kind == IR_ALLOC) {
+            mark_used(ir->alloc.var);
+        }
+        Operand *dest = NULL;
+        if (ir->kind == IR_ASSIGN || ir->kind == IR_CALL) {
+            dest = ir->result;
+        } else if (ir->kind == IR_READ) {
+            dest = ir->arg1;
+        }
+        if (dest != NULL && dest->kind == INDIR) {
+            mark_read(dest->indir_var);
+        }
+        mark_used(dest);
+    }
+}
+
 void generate_asm() {
     info("generating mips...");
+    find_uses();
     generate_data();
     generate_func();
     for (IRNode *q = irList.head; q != NULL; q = q->next) {
+        if (translate_tail_call(q)) {
+            // the RETURN is not reached
+            q = q->next;
+            continue;
+        }
         IR *ir = q->ir;
         translate_IR(ir);
     }
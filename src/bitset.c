@@ -0,0 +1,83 @@
+#include "bitset.h"
+
+#define BITS (8 * sizeof(unsigned))
+
+Bitset *newBitset(int size) {
+    Bitset *set = malloc(sizeof(Bitset));
+    set->size = size;
+    set->nr_word = (size + BITS - 1) / BITS;
+    set->word = malloc(set->nr_word * sizeof(unsigned) + 1);
+    Bitset_clear(set);
+    return set;
+}
+
+void Bitset_set(Bitset *set, int i) {
+    set->word[i / BITS] |= 1u << (i % BITS);
+}
+
+void Bitset_unset(Bitset *set, int i) {
+    set->word[i / BITS] &= ~(1u << (i % BITS));
+}
+
+bool Bitset_test(Bitset *set, int i) {
+    return (set->word[i / BITS] >> (i % BITS)) & 1u;
+}
+
+void Bitset_fill(Bitset *set) {
+    for (int i = 0; i < set->size; i++) {
+        Bitset_set(set, i);
+    }
+}
+
+void Bitset_clear(Bitset *set) {
+    memset(set->word, 0, set->nr_word * sizeof(unsigned));
+}
+
+void Bitset_copy(Bitset *dst, Bitset *src) {
+    memcpy(dst->word, src->word, dst->nr_word * sizeof(unsigned));
+}
+
+// the set operations return true if dst is changed
+bool Bitset_union(Bitset *dst, Bitset *src) {
+    bool changed = false;
+    for (int i = 0; i < dst->nr_word; i++) {
+        unsigned w = dst->word[i] | src->word[i];
+        if (w != dst->word[i]) {
+            dst->word[i] = w;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool Bitset_intersect(Bitset *dst, Bitset *src) {
+    bool changed = false;
+    for (int i = 0; i < dst->nr_word; i++) {
+        unsigned w = dst->word[i] & src->word[i];
+        if (w != dst->word[i]) {
+            dst->word[i] = w;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void Bitset_diff(Bitset *dst, Bitset *src) {
+    for (int i = 0; i < dst->nr_word; i++) {
+        dst->word[i] &= ~src->word[i];
+    }
+}
+
+bool Bitset_equals(Bitset *a, Bitset *b) {
+    return memcmp(a->word, b->word, a->nr_word * sizeof(unsigned)) == 0;
+}
+
+int Bitset_count(Bitset *set) {
+    int n = 0;
+    for (int i = 0; i < set->size; i++) {
+        if (Bitset_test(set, i)) {
+            n++;
+        }
+    }
+    return n;
+}
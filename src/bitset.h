@@ -0,0 +1,25 @@
+#ifndef __BITSET_H__
+#define __BITSET_H__
+
+#include "common.h"
+
+typedef struct {
+    int size;
+    int nr_word;
+    unsigned *word;
+} Bitset;
+
+Bitset *newBitset(int size);
+void Bitset_set(Bitset *set, int i);
+void Bitset_unset(Bitset *set, int i);
+bool Bitset_test(Bitset *set, int i);
+void Bitset_fill(Bitset *set);
+void Bitset_clear(Bitset *set);
+void Bitset_copy(Bitset *dst, Bitset *src);
+bool Bitset_union(Bitset *dst, Bitset *src);
+bool Bitset_intersect(Bitset *dst, Bitset *src);
+void Bitset_diff(Bitset *dst, Bitset *src);
+bool Bitset_equals(Bitset *a, Bitset *b);
+int Bitset_count(Bitset *set);
+
+#endif
@@ -0,0 +1,220 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+
+// jump threading and branch chain simplification
+
+#define MAX_THREAD 32
+
+static int nr_simplified;
+
+static Label **jump_label(IR *ir) {
+    if (ir->kind == IR_GOTO) {
+        return &ir->goto_.label;
+    } else if (ir->kind == IR_IF) {
+        return &ir->if_.label;
+    } else {
+        return NULL;
+    }
+}
+
+static IRNode *find_label(IRNode *func, IRNode *end, int label_no) {
+    for (IRNode *q = func->next; q != end; q = q->next) {
+        if (q->ir->kind == IR_LABEL && q->ir->label.label_no == label_no) {
+            return q;
+        }
+    }
+    return NULL;
+}
+
+// is LABEL label_no in the run of labels starting at q
+static bool labels_at(IRNode *q, IRNode *end, int label_no) {
+    for (; q != end && q->ir->kind == IR_LABEL; q = q->next) {
+        if (q->ir->label.label_no == label_no) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// LABEL L1 followed by LABEL L2: jumps to L2 go to L1
+static bool merge_labels(IRNode *func, IRNode *end) {
+    bool changed = false;
+    for (IRNode *q = func->next; q != end; q = q->next) {
+        if (q->ir->kind != IR_LABEL) {
+            continue;
+        }
+        while (q->next != end && q->next->ir->kind == IR_LABEL) {
+            IRNode *second = q->next;
+            int from = second->ir->label.label_no;
+            int to = q->ir->label.label_no;
+            for (IRNode *r = func->next; r != end; r = r->next) {
+                Label **label = jump_label(r->ir);
+                if (label != NULL && label_number(*label) == from) {
+                    *label = label_of(to);
+                }
+            }
+            info("merge label L%d into L%d", from, to);
+            IRList_remove(second);
+            nr_simplified++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// the label a jump to label_no ends up at, following `GOTO L's
+static int thread_target(IRNode *func, IRNode *end, IRNode *jump,
+        int label_no) {
+    int seen[MAX_THREAD];
+    int nr_seen = 0;
+    seen[nr_seen++] = label_no;
+    while (nr_seen < MAX_THREAD) {
+        IRNode *next = find_label(func, end, label_no);
+        while (next != NULL && next != end && next->ir->kind == IR_LABEL) {
+            next = next->next;
+        }
+        if (next == NULL || next == end || next == jump
+                || next->ir->kind != IR_GOTO) {
+            break;
+        }
+        int target = label_number(next->ir->goto_.label);
+        for (int i = 0; i < nr_seen; i++) {
+            if (seen[i] == target) {
+                // a loop of jumps
+                return label_no;
+            }
+        }
+        seen[nr_seen++] = target;
+        label_no = target;
+    }
+    return label_no;
+}
+
+// a jump to a label followed by `GOTO L' goes to L directly
+static bool thread_jumps(IRNode *func, IRNode *end) {
+    bool changed = false;
+    for (IRNode *q = func->next; q != end; q = q->next) {
+        Label **label = jump_label(q->ir);
+        if (label == NULL) {
+            continue;
+        }
+        int target = thread_target(func, end, q, label_number(*label));
+        if (target != label_number(*label)) {
+            info("thread %s to L%d", ir_repr(q->ir), target);
+            *label = label_of(target);
+            nr_simplified++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// IF c GOTO L1; GOTO L2; LABEL L1  =>  IF !c GOTO L2; LABEL L1
+// and jumps to the label right after them are removed
+static bool simplify_jumps(IRNode *func, IRNode *end) {
+    bool changed = false;
+    IRNode *q = func->next;
+    while (q != end) {
+        IRNode *next = q->next;
+        IR *ir = q->ir;
+        if (ir->kind == IR_IF && next != end
+                && next->ir->kind == IR_GOTO
+                && next->next != end
+                && labels_at(next->next, end,
+                    label_number(ir->if_.label))) {
+            info("invert %s", ir_repr(ir));
+            ir->if_.relop = invert_relop(ir->if_.relop);
+            ir->if_.label = next->ir->goto_.label;
+            IRList_remove(next);
+            nr_simplified++;
+            changed = true;
+            continue;
+        }
+        Label **label = jump_label(ir);
+        if (label != NULL && next != end
+                && labels_at(next, end, label_number(*label))) {
+            info("jump to the next label: %s", ir_repr(ir));
+            IRList_remove(q);
+            nr_simplified++;
+            changed = true;
+        }
+        q = next;
+    }
+    return changed;
+}
+
+void simplify_branches() {
+    info("simplifying branches...");
+    nr_simplified = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        bool changed = true;
+        while (changed) {
+            IRNode *end = next_function(f);
+            changed = merge_labels(f, end);
+            changed = thread_jumps(f, end) || changed;
+            changed = simplify_jumps(f, end) || changed;
+        }
+    }
+    info("%d branches simplified", nr_simplified);
+}
+
+static bool label_used(IRNode *func, IRNode *end, int label_no) {
+    for (IRNode *q = func->next; q != end; q = q->next) {
+        Label **label = jump_label(q->ir);
+        if (label != NULL && label_number(*label) == label_no) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// blocks not reachable from the function entry, keeping DECs
+static void remove_unreachable_blocks(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    compute_dominators(cfg);
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        if (b->reachable) {
+            continue;
+        }
+        IRNode *stop = b->last->next;
+        IRNode *q = b->first;
+        while (q != stop) {
+            IRNode *next = q->next;
+            if (q->ir->kind != IR_ALLOC) {
+                info("unreachable: %s", ir_repr(q->ir));
+                IRList_remove(q);
+                nr_simplified++;
+            }
+            q = next;
+        }
+    }
+}
+
+static void remove_unused_labels(IRNode *func) {
+    IRNode *end = next_function(func);
+    IRNode *q = func->next;
+    while (q != end) {
+        IRNode *next = q->next;
+        if (q->ir->kind == IR_LABEL
+                && !label_used(func, end, q->ir->label.label_no)) {
+            info("unused label: %s", ir_repr(q->ir));
+            IRList_remove(q);
+            nr_simplified++;
+        }
+        q = next;
+    }
+}
+
+// returns the number of instructions and labels removed
+int eliminate_unreachable_code() {
+    info("eliminating unreachable code...");
+    nr_simplified = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        remove_unreachable_blocks(f);
+        remove_unused_labels(f);
+    }
+    info("%d unreachable instructions and labels removed", nr_simplified);
+    return nr_simplified;
+}
@@ -0,0 +1,225 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "callgraph.h"
+
+// the call graph of the program: a function for each FUNCTION node,
+// an edge for each CALL, and the strongly connected components found
+// by Tarjan's algorithm, numbered so that callees come first
+
+typedef struct {
+    int index;
+    int *number;   // visiting order, -1 if not visited
+    int *low;
+    bool *on_stack;
+    int nr_stack;
+    Function **stack;
+    int nr_done;
+} Tarjan;
+
+Function *find_function(CallGraph *cg, char *name) {
+    for (int i = 0; i < cg->nr_func; i++) {
+        if (strcmp(cg->funcs[i]->name, name) == 0) {
+            return cg->funcs[i];
+        }
+    }
+    return NULL;
+}
+
+Function *callee_of(CallGraph *cg, IR *call) {
+    return find_function(cg, call->arg1->sym_name);
+}
+
+int nr_params(Function *f) {
+    int n = 0;
+    for (IRNode *q = f->node->next; q != f->end && q->ir->kind == IR_PARAM;
+            q = q->next) {
+        n++;
+    }
+    return n;
+}
+
+// the ARG nodes of a call in f, the first parameter first, found by
+// replaying the pushes and the pops of the argument stack; the number
+// of other arguments still pushed is stored in nr_pending
+IRNode **find_args(CallGraph *cg, Function *f, IRNode *call, int *nr_pending) {
+    int nr_stack = 0;
+    IRNode **stack = NULL;
+    for (IRNode *q = f->node->next; q != call; q = q->next) {
+        if (q->ir->kind == IR_ARG) {
+            stack = realloc(stack, (nr_stack + 1) * sizeof(IRNode *));
+            stack[nr_stack++] = q;
+        } else if (q->ir->kind == IR_CALL) {
+            nr_stack -= nr_params(callee_of(cg, q->ir));
+            if (nr_stack < 0) {
+                return NULL;
+            }
+        }
+    }
+    int n = nr_params(callee_of(cg, call->ir));
+    if (nr_stack < n) {
+        return NULL;
+    }
+    IRNode **args = malloc((n + 1) * sizeof(IRNode *));
+    for (int i = 0; i < n; i++) {
+        args[i] = stack[nr_stack - 1 - i];
+    }
+    *nr_pending = nr_stack - n;
+    return args;
+}
+
+// whether f only reads the parameter as a whole operand, not through
+// an address or a store, and never assigns it
+bool is_plain_param(Function *f, Operand *op) {
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_PARAM) {
+            continue;
+        }
+        Operand *def = ir_def(ir);
+        Operand *store = ir_store(ir);
+        if (def != NULL && op_contains(def, op)
+                || store != NULL && op_contains(store, op)) {
+            return false;
+        }
+        Operand **slots[MAX_READ_SLOT];
+        int n = ir_read_slots(ir, slots);
+        for (int i = 0; i < n; i++) {
+            if (!op_equals(*slots[i], op) && op_contains(*slots[i], op)) {
+                return false;
+            }
+        }
+        if (ir->kind == IR_ALLOC && op_contains(ir->alloc.var, op)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void add_to(Function ***list, int *n, Function *f) {
+    for (int i = 0; i < *n; i++) {
+        if ((*list)[i] == f) {
+            return;
+        }
+    }
+    *list = realloc(*list, (*n + 1) * sizeof(Function *));
+    (*list)[(*n)++] = f;
+}
+
+static void mark_reachable(Function *f) {
+    if (f->reachable) {
+        return;
+    }
+    f->reachable = true;
+    for (int i = 0; i < f->nr_callee; i++) {
+        mark_reachable(f->callees[i]);
+    }
+}
+
+static void strong_connect(CallGraph *cg, Tarjan *t, Function *f) {
+    t->number[f->id] = t->low[f->id] = t->index++;
+    t->stack[t->nr_stack++] = f;
+    t->on_stack[f->id] = true;
+    for (int i = 0; i < f->nr_callee; i++) {
+        Function *g = f->callees[i];
+        if (t->number[g->id] < 0) {
+            strong_connect(cg, t, g);
+            if (t->low[g->id] < t->low[f->id]) {
+                t->low[f->id] = t->low[g->id];
+            }
+        } else if (t->on_stack[g->id] && t->number[g->id] < t->low[f->id]) {
+            t->low[f->id] = t->number[g->id];
+        }
+    }
+    if (t->low[f->id] != t->number[f->id]) {
+        return;
+    }
+    // f is the root of a component, which is complete on the stack
+    int first = t->nr_done;
+    Function *g;
+    do {
+        g = t->stack[--t->nr_stack];
+        t->on_stack[g->id] = false;
+        g->scc = cg->nr_scc;
+        cg->bottom_up[t->nr_done++] = g;
+    } while (g != f);
+    bool recursive = t->nr_done - first > 1;
+    for (int i = 0; i < f->nr_callee; i++) {
+        if (f->callees[i] == f) {
+            recursive = true;
+        }
+    }
+    for (int i = first; i < t->nr_done; i++) {
+        cg->bottom_up[i]->recursive = recursive;
+    }
+    cg->nr_scc++;
+}
+
+CallGraph *newCallGraph() {
+    CallGraph *cg = malloc(sizeof(CallGraph));
+    cg->nr_func = 0;
+    cg->funcs = NULL;
+    cg->nr_scc = 0;
+    cg->main = NULL;
+    for (IRNode *q = next_function(NULL); q != NULL; q = next_function(q)) {
+        Function *f = malloc(sizeof(Function));
+        f->id = cg->nr_func;
+        f->name = q->ir->function.name;
+        f->node = q;
+        f->end = next_function(q);
+        f->nr_call = 0;
+        f->calls = NULL;
+        f->nr_callee = 0;
+        f->callees = NULL;
+        f->nr_caller = 0;
+        f->callers = NULL;
+        f->scc = -1;
+        f->recursive = false;
+        f->reachable = false;
+        cg->funcs = realloc(cg->funcs, (cg->nr_func + 1) * sizeof(Function *));
+        cg->funcs[cg->nr_func++] = f;
+        if (strcmp(f->name, "main") == 0) {
+            cg->main = f;
+        }
+    }
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *f = cg->funcs[i];
+        for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+            if (q->ir->kind != IR_CALL) {
+                continue;
+            }
+            Function *g = callee_of(cg, q->ir);
+            if (g == NULL) {
+                fatal("call to unknown function %s", q->ir->arg1->sym_name);
+            }
+            f->calls = realloc(f->calls, (f->nr_call + 1) * sizeof(IRNode *));
+            f->calls[f->nr_call++] = q;
+            add_to(&f->callees, &f->nr_callee, g);
+            add_to(&g->callers, &g->nr_caller, f);
+        }
+    }
+    if (cg->main != NULL) {
+        mark_reachable(cg->main);
+    }
+
+    int n = cg->nr_func;
+    cg->bottom_up = malloc((n + 1) * sizeof(Function *));
+    Tarjan *t = malloc(sizeof(Tarjan));
+    t->index = 0;
+    t->number = malloc((n + 1) * sizeof(int));
+    t->low = malloc((n + 1) * sizeof(int));
+    t->on_stack = malloc((n + 1) * sizeof(bool));
+    t->stack = malloc((n + 1) * sizeof(Function *));
+    t->nr_stack = 0;
+    t->nr_done = 0;
+    for (int i = 0; i < n; i++) {
+        t->number[i] = -1;
+        t->on_stack[i] = false;
+    }
+    for (int i = 0; i < n; i++) {
+        if (t->number[i] < 0) {
+            strong_connect(cg, t, cg->funcs[i]);
+        }
+    }
+    return cg;
+}
@@ -0,0 +1,40 @@
+#ifndef __CALLGRAPH_H__
+#define __CALLGRAPH_H__
+
+#include "common.h"
+#include "ir.h"
+
+typedef struct Function_ Function;
+
+struct Function_ {
+    int id;
+    char *name;
+    IRNode *node;        // the FUNCTION node
+    IRNode *end;         // node after the function, may be NULL
+    int nr_call;
+    IRNode **calls;      // the CALL nodes in the function
+    int nr_callee;
+    Function **callees;  // distinct
+    int nr_caller;
+    Function **callers;  // distinct
+    int scc;             // callees are in the same or a smaller scc
+    bool recursive;      // in a cycle of calls
+    bool reachable;      // from main
+};
+
+typedef struct {
+    int nr_func;
+    Function **funcs;     // in list order
+    Function **bottom_up; // callees before callers, by scc
+    int nr_scc;
+    Function *main;
+} CallGraph;
+
+CallGraph *newCallGraph();
+Function *find_function(CallGraph *cg, char *name);
+Function *callee_of(CallGraph *cg, IR *call);
+int nr_params(Function *f);
+IRNode **find_args(CallGraph *cg, Function *f, IRNode *call, int *nr_pending);
+bool is_plain_param(Function *f, Operand *param);
+
+#endif
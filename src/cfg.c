@@ -0,0 +1,347 @@
+#include "cfg.h"
+#include "bitset.h"
+
+extern IRList irList;
+
+// the first FUNCTION node after q, or the first one when q is NULL
+IRNode *next_function(IRNode *q) {
+    q = (q == NULL) ? irList.head : q->next;
+    while (q != NULL && q->ir->kind != IR_FUNCTION) {
+        q = q->next;
+    }
+    return q;
+}
+
+static bool is_jump(IR *ir) {
+    return ir->kind == IR_GOTO
+        || ir->kind == IR_IF
+        || ir->kind == IR_RETURN;
+}
+
+static bool is_leader(IRNode *func, IRNode *q) {
+    if (q->prev == func) {
+        return true;
+    }
+    if (q->ir->kind == IR_LABEL) {
+        // consecutive labels share a block
+        return q->prev->ir->kind != IR_LABEL;
+    }
+    return is_jump(q->prev->ir);
+}
+
+static Block *newBlock(int id, IRNode *first) {
+    Block *block = malloc(sizeof(Block));
+    block->id = id;
+    block->first = first;
+    block->last = first;
+    block->nr_succ = 0;
+    block->nr_pred = 0;
+    block->pred = NULL;
+    block->reachable = true;
+    block->reaches_exit = true;
+    block->idom = NULL;
+    block->ipdom = NULL;
+    block->loop_depth = 0;
+    return block;
+}
+
+Block *block_of_label(CFG *cfg, int label_no) {
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        for (IRNode *q = b->first;
+                q->ir->kind == IR_LABEL; q = q->next) {
+            if (q->ir->label.label_no == label_no) {
+                return b;
+            }
+            if (q == b->last) {
+                break;
+            }
+        }
+    }
+    fatal("label L%d is not in the function", label_no);
+}
+
+static void add_edge(Block *from, Block *to) {
+    for (int i = 0; i < from->nr_succ; i++) {
+        if (from->succ[i] == to) {
+            return;
+        }
+    }
+    from->succ[from->nr_succ++] = to;
+    to->pred = realloc(to->pred, (to->nr_pred + 1) * sizeof(Block *));
+    to->pred[to->nr_pred++] = from;
+}
+
+CFG *newCFG(IRNode *func) {
+    CFG *cfg = malloc(sizeof(CFG));
+    cfg->func = func;
+    cfg->nr_block = 0;
+    cfg->blocks = NULL;
+
+    IRNode *q = func->next;
+    while (q != NULL && q->ir->kind != IR_FUNCTION) {
+        if (is_leader(func, q)) {
+            cfg->blocks = realloc(cfg->blocks,
+                    (cfg->nr_block + 1) * sizeof(Block *));
+            cfg->blocks[cfg->nr_block] = newBlock(cfg->nr_block, q);
+            cfg->nr_block++;
+        } else {
+            cfg->blocks[cfg->nr_block - 1]->last = q;
+        }
+        q = q->next;
+    }
+    cfg->end = q;
+
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        Block *next = (i + 1 < cfg->nr_block) ? cfg->blocks[i+1] : NULL;
+        IR *ir = b->last->ir;
+        if (ir->kind == IR_GOTO) {
+            add_edge(b, block_of_label(cfg, label_number(ir->goto_.label)));
+        } else if (ir->kind == IR_IF) {
+            if (next != NULL) {
+                add_edge(b, next);
+            }
+            add_edge(b, block_of_label(cfg, label_number(ir->if_.label)));
+        } else if (ir->kind != IR_RETURN && next != NULL) {
+            add_edge(b, next);
+        }
+    }
+    return cfg;
+}
+
+// the label of block b, a new one is placed if it has none
+Label *block_label(Block *b) {
+    if (b->first->ir->kind == IR_LABEL) {
+        return label_of(b->first->ir->label.label_no);
+    }
+    Label *label = newLabel();
+    b->first = IRList_insert_before(b->first, newLabelIR(label));
+    return label;
+}
+
+static bool is_barrier(IR *ir) {
+    return ir->kind == IR_GOTO || ir->kind == IR_RETURN;
+}
+
+// place irs so that they run exactly when control goes from `from'
+// to `to', or on function entry if from is NULL; the CFG is not
+// updated
+void insert_on_edge(CFG *cfg, Block *from, Block *to, IR **irs, int nr_ir) {
+    IRNode *pos;
+    if (from == NULL) {
+        pos = cfg->func;
+    } else if (from->nr_succ == 1) {
+        IR *last = from->last->ir;
+        pos = (last->kind == IR_GOTO || last->kind == IR_IF)
+            ? from->last->prev : from->last;
+    } else if (to->nr_pred == 1) {
+        pos = to->first->prev;
+        while (pos->next->ir->kind == IR_LABEL) {
+            pos = pos->next;
+        }
+    } else if (from->succ[0] == to) {
+        // a new block between the conditional jump and its successor
+        pos = from->last;
+    } else {
+        // a new block the conditional jump goes to instead
+        Label *split = newLabel();
+        Label *target = block_label(to);
+        from->last->ir->if_.label = split;
+        IRNode *barrier = from->last->next;
+        while (barrier != cfg->end && !is_barrier(barrier->ir)) {
+            barrier = barrier->next;
+        }
+        if (barrier == cfg->end) {
+            // jump over the new block
+            Label *skip = newLabel();
+            barrier = IRList_insert_after(from->last, newGoto(skip));
+            IRList_insert_after(barrier, newLabelIR(skip));
+        }
+        pos = IRList_insert_after(barrier, newLabelIR(split));
+        IRList_insert_after(pos, newGoto(target));
+    }
+    for (int i = 0; i < nr_ir; i++) {
+        pos = IRList_insert_after(pos, irs[i]);
+    }
+}
+
+static void mark_reachable(Block *b, bool forward) {
+    if (forward ? b->reachable : b->reaches_exit) {
+        return;
+    }
+    if (forward) {
+        b->reachable = true;
+        for (int i = 0; i < b->nr_succ; i++) {
+            mark_reachable(b->succ[i], true);
+        }
+    } else {
+        b->reaches_exit = true;
+        for (int i = 0; i < b->nr_pred; i++) {
+            mark_reachable(b->pred[i], false);
+        }
+    }
+}
+
+// iterative dominator sets, forward from the entry block or backward
+// from a virtual exit numbered nr_block that follows every block
+// without successors
+static Bitset **dominator_sets(CFG *cfg, bool post) {
+    int n = cfg->nr_block;
+    Bitset **dom = malloc((n + 1) * sizeof(Bitset *));
+    for (int i = 0; i <= n; i++) {
+        dom[i] = newBitset(n + 1);
+        Bitset_fill(dom[i]);
+    }
+    int root = post ? n : 0;
+    Bitset_clear(dom[root]);
+    Bitset_set(dom[root], root);
+    Bitset *tmp = newBitset(n + 1);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < n; k++) {
+            int i = post ? n - 1 - k : k;
+            Block *b = cfg->blocks[i];
+            if (i == root || !(post ? b->reaches_exit : b->reachable)) {
+                continue;
+            }
+            Bitset_fill(tmp);
+            if (post) {
+                for (int j = 0; j < b->nr_succ; j++) {
+                    Bitset_intersect(tmp, dom[b->succ[j]->id]);
+                }
+                if (b->nr_succ == 0) {
+                    Bitset_intersect(tmp, dom[n]);
+                }
+            } else {
+                for (int j = 0; j < b->nr_pred; j++) {
+                    Bitset_intersect(tmp, dom[b->pred[j]->id]);
+                }
+            }
+            Bitset_set(tmp, i);
+            if (!Bitset_equals(tmp, dom[i])) {
+                Bitset_copy(dom[i], tmp);
+                changed = true;
+            }
+        }
+    }
+    return dom;
+}
+
+// the immediate dominator is the strict dominator with most dominators
+static int immediate(Bitset **dom, int i, int n) {
+    int best = -1, best_count = -1;
+    for (int j = 0; j <= n; j++) {
+        if (j != i && Bitset_test(dom[i], j)) {
+            int count = Bitset_count(dom[j]);
+            if (count > best_count) {
+                best = j;
+                best_count = count;
+            }
+        }
+    }
+    return best;
+}
+
+void compute_dominators(CFG *cfg) {
+    int n = cfg->nr_block;
+    for (int i = 0; i < n; i++) {
+        cfg->blocks[i]->reachable = false;
+        cfg->blocks[i]->idom = NULL;
+    }
+    if (n == 0) {
+        return;
+    }
+    mark_reachable(cfg->blocks[0], true);
+    Bitset **dom = dominator_sets(cfg, false);
+    for (int i = 1; i < n; i++) {
+        Block *b = cfg->blocks[i];
+        if (b->reachable) {
+            b->idom = cfg->blocks[immediate(dom, i, n)];
+        }
+    }
+}
+
+void compute_postdominators(CFG *cfg) {
+    int n = cfg->nr_block;
+    for (int i = 0; i < n; i++) {
+        cfg->blocks[i]->reaches_exit = false;
+        cfg->blocks[i]->ipdom = NULL;
+    }
+    for (int i = 0; i < n; i++) {
+        if (cfg->blocks[i]->nr_succ == 0) {
+            mark_reachable(cfg->blocks[i], false);
+        }
+    }
+    Bitset **pdom = dominator_sets(cfg, true);
+    for (int i = 0; i < n; i++) {
+        Block *b = cfg->blocks[i];
+        if (b->reaches_exit) {
+            int j = immediate(pdom, i, n);
+            b->ipdom = (j == n) ? NULL : cfg->blocks[j];
+        }
+    }
+}
+
+// does a dominate b, both reachable
+bool dominates(Block *a, Block *b) {
+    while (b != NULL && b != a) {
+        b = b->idom;
+    }
+    return b == a;
+}
+
+bool is_back_edge(Block *from, Block *to) {
+    return from->reachable && to->reachable && dominates(to, from);
+}
+
+static void add_to_loop(Loop *loop, Block *b) {
+    if (loop->body[b->id]) {
+        return;
+    }
+    loop->body[b->id] = true;
+    for (int i = 0; i < b->nr_pred; i++) {
+        if (b->pred[i]->reachable) {
+            add_to_loop(loop, b->pred[i]);
+        }
+    }
+}
+
+// natural loops, one for each header, after compute_dominators; the
+// blocks that reach a back edge without passing the header are in the
+// loop; returns the number of loops
+int find_loops(CFG *cfg, Loop **loops) {
+    int n = cfg->nr_block;
+    int nr_loop = 0;
+    *loops = malloc((n + 1) * sizeof(Loop));
+    for (int i = 0; i < n; i++) {
+        Block *h = cfg->blocks[i];
+        Loop *loop = NULL;
+        for (int k = 0; k < h->nr_pred; k++) {
+            Block *t = h->pred[k];
+            if (!is_back_edge(t, h)) {
+                continue;
+            }
+            if (loop == NULL) {
+                loop = &(*loops)[nr_loop++];
+                loop->header = h;
+                loop->body = malloc(n * sizeof(bool));
+                for (int j = 0; j < n; j++) {
+                    loop->body[j] = false;
+                }
+                loop->body[h->id] = true;
+            }
+            add_to_loop(loop, t);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        cfg->blocks[i]->loop_depth = 0;
+        for (int l = 0; l < nr_loop; l++) {
+            if ((*loops)[l].body[i]) {
+                cfg->blocks[i]->loop_depth++;
+            }
+        }
+    }
+    return nr_loop;
+}
@@ -0,0 +1,49 @@
+#ifndef __CFG_H__
+#define __CFG_H__
+
+#include "common.h"
+#include "ir.h"
+
+typedef struct Block_ Block;
+
+struct Block_ {
+    int id;
+    IRNode *first;  // first node of the block
+    IRNode *last;   // last node of the block, inclusive
+    int nr_succ;
+    // for a conditional jump, succ[0] falls through, succ[1] is the target
+    Block *succ[2];
+    int nr_pred;
+    Block **pred;
+    // filled by compute_dominators and compute_postdominators
+    bool reachable;     // from the entry
+    bool reaches_exit;
+    Block *idom;        // NULL for the entry
+    Block *ipdom;       // NULL if only the exit postdominates it
+    int loop_depth;     // filled by find_loops
+};
+
+typedef struct {
+    Block *header;
+    bool *body;  // body[id] tells if the block is in the loop
+} Loop;
+
+typedef struct {
+    IRNode *func;    // the FUNCTION node
+    IRNode *end;     // node after the last block, may be NULL
+    int nr_block;
+    Block **blocks;  // in list order, the entry block first
+} CFG;
+
+IRNode *next_function(IRNode *q);
+CFG *newCFG(IRNode *func);
+Block *block_of_label(CFG *cfg, int label_no);
+Label *block_label(Block *b);
+void compute_dominators(CFG *cfg);
+void compute_postdominators(CFG *cfg);
+bool dominates(Block *a, Block *b);
+bool is_back_edge(Block *from, Block *to);
+int find_loops(CFG *cfg, Loop **loops);
+void insert_on_edge(CFG *cfg, Block *from, Block *to, IR **irs, int nr_ir);
+
+#endif
@@ -0,0 +1,162 @@
+#include "common.h"
+#include "ir.h"
+#include "callgraph.h"
+
+// dead argument elimination: a parameter that the function never reads
+// is removed with its PARAM and with the ARG at every call site, so the
+// argument is neither computed nor pushed; a function whose result no
+// caller uses returns #0, so the returned value is not computed
+//
+// the code generator does not store the result of a call that is never
+// read either
+
+static CallGraph *cg;
+static int nr_removed;
+static int nr_returns;
+
+static bool is_read(Function *f, Operand *op) {
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        Operand *store = ir_store(q->ir);
+        if (q->ir->kind != IR_PARAM && ir_contains(q->ir, op)
+                || store != NULL && op_contains(store->indir_var, op)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the ARG nodes of every call to g, NULL if some are not found
+static IRNode ***find_all_args(Function *g) {
+    int nr_site = 0;
+    IRNode ***sites = NULL;
+    for (int k = 0; k < g->nr_caller; k++) {
+        Function *f = g->callers[k];
+        for (int j = 0; j < f->nr_call; j++) {
+            IRNode *call = f->calls[j];
+            if (callee_of(cg, call->ir) != g) {
+                continue;
+            }
+            int nr_pending;
+            IRNode **args = find_args(cg, f, call, &nr_pending);
+            if (args == NULL) {
+                return NULL;
+            }
+            sites = realloc(sites, (nr_site + 2) * sizeof(IRNode **));
+            sites[nr_site++] = args;
+        }
+    }
+    sites = realloc(sites, (nr_site + 1) * sizeof(IRNode **));
+    sites[nr_site] = NULL;
+    return sites;
+}
+
+static void remove_dead_params(Function *g) {
+    int n = nr_params(g);
+    IRNode ***sites = find_all_args(g);
+    if (sites == NULL) {
+        return;
+    }
+    // the ARGs are all found before any is removed
+    IRNode *param = g->node->next;
+    for (int i = 0; i < n; i++) {
+        IRNode *next = param->next;
+        if (!is_read(g, param->ir->arg1)) {
+            info("remove parameter %s of %s",
+                    param->ir->arg1->var_name, g->name);
+            for (int k = 0; sites[k] != NULL; k++) {
+                IRList_remove(sites[k][i]);
+            }
+            IRList_remove(param);
+            nr_removed++;
+        }
+        param = next;
+    }
+}
+
+static bool is_result_used(Function *g) {
+    for (int k = 0; k < g->nr_caller; k++) {
+        Function *f = g->callers[k];
+        for (int j = 0; j < f->nr_call; j++) {
+            IR *call = f->calls[j]->ir;
+            if (callee_of(cg, call) == g && call->result != NULL
+                    && (call->result->kind != TEMP
+                        || is_read(f, call->result))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool is_computation(IR *ir) {
+    return ir->kind == IR_ASSIGN
+        || ir->kind == IR_ADD
+        || ir->kind == IR_SUB
+        || ir->kind == IR_MUL
+        || ir->kind == IR_DIV
+        || ir->kind == IR_CMP
+        || ir->kind == IR_SELECT
+        || ir->kind == IR_SHL
+        || ir->kind == IR_SHR
+        || ir->kind == IR_SHRU
+        || ir->kind == IR_MULH;
+}
+
+// the temps that computed the returned values, so that the parameters
+// they read are seen to be dead
+static void remove_dead_temps(Function *g) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        IRNode *q = g->node->next;
+        while (q != g->end) {
+            IRNode *next = q->next;
+            Operand *def = ir_def(q->ir);
+            if (is_computation(q->ir) && def != NULL && def->kind == TEMP
+                    && !is_read(g, def)) {
+                IRList_remove(q);
+                changed = true;
+            }
+            q = next;
+        }
+    }
+}
+
+static void remove_dead_returns(Function *g) {
+    if (is_result_used(g)) {
+        return;
+    }
+    bool changed = false;
+    for (IRNode *q = g->node->next; q != g->end; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_RETURN && ir->arg1->kind != INT_LITERAL) {
+            q->ir = newReturn(newIntLiteral(0));
+            nr_returns++;
+            changed = true;
+        }
+    }
+    if (changed) {
+        remove_dead_temps(g);
+    }
+}
+
+void eliminate_dead_arguments() {
+    info("eliminating dead arguments...");
+    nr_removed = 0;
+    nr_returns = 0;
+    cg = newCallGraph();
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *g = cg->funcs[i];
+        if (g != cg->main && g->reachable) {
+            remove_dead_returns(g);
+        }
+    }
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *g = cg->funcs[i];
+        if (g != cg->main && g->reachable) {
+            remove_dead_params(g);
+        }
+    }
+    info("%d parameters removed, %d returns not computed",
+            nr_removed, nr_returns);
+}
@@ -0,0 +1,402 @@
+#include "dep.h"
+
+static void affine_init(Affine *a) {
+    memset(a, 0, sizeof(Affine));
+}
+
+static bool affine_add_sym(Affine *a, Operand *sym, int coef) {
+    for (int j = 0; j < a->nr_sym; j++) {
+        if (op_equals(a->sym[j], sym)) {
+            a->sym_coef[j] += coef;
+            return true;
+        }
+    }
+    if (a->nr_sym == MAX_SYM) {
+        return false;
+    }
+    a->sym[a->nr_sym] = sym;
+    a->sym_coef[a->nr_sym] = coef;
+    a->nr_sym++;
+    return true;
+}
+
+// out = x + sign * y
+static bool affine_combine(Affine *out, Affine *x, Affine *y, int sign) {
+    Affine r = *x;
+    r.cst += sign * y->cst;
+    for (int k = 0; k < MAX_LEVEL; k++) {
+        r.coef[k] += sign * y->coef[k];
+    }
+    for (int j = 0; j < y->nr_sym; j++) {
+        if (!affine_add_sym(&r, y->sym[j], sign * y->sym_coef[j])) {
+            return false;
+        }
+    }
+    *out = r;
+    return true;
+}
+
+static void affine_scale(Affine *a, int k) {
+    a->cst *= k;
+    for (int i = 0; i < MAX_LEVEL; i++) {
+        a->coef[i] *= k;
+    }
+    for (int j = 0; j < a->nr_sym; j++) {
+        a->sym_coef[j] *= k;
+    }
+}
+
+static bool affine_is_const(Affine *a) {
+    for (int k = 0; k < MAX_LEVEL; k++) {
+        if (a->coef[k] != 0) {
+            return false;
+        }
+    }
+    for (int j = 0; j < a->nr_sym; j++) {
+        if (a->sym_coef[j] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static IR *find_def(IRNode *from, IRNode *to, Operand *op, int *nr_def) {
+    IR *def = NULL;
+    *nr_def = 0;
+    for (IRNode *q = from; q != to; q = q->next) {
+        Operand *d = ir_def(q->ir);
+        if (d != NULL && op_equals(d, op)) {
+            def = q->ir;
+            *nr_def += 1;
+        }
+    }
+    return def;
+}
+
+static bool eval_affine_rec(Operand *op, IRNode *from, IRNode *to,
+        LoopLevel *levels, int nr_level, Affine *out, int depth) {
+    affine_init(out);
+    if (depth > 32) {
+        return false;
+    }
+    if (op->kind == INT_LITERAL) {
+        out->cst = op->int_value;
+        return true;
+    }
+    if (op->kind != TEMP && op->kind != VAR_OPERAND) {
+        return false;
+    }
+    for (int k = 0; k < nr_level; k++) {
+        if (op_equals(op, levels[k].iv)) {
+            out->coef[k] = 1;
+            return true;
+        }
+    }
+    int nr_def;
+    IR *def = find_def(from, to, op, &nr_def);
+    if (nr_def == 0) {
+        // invariant in the region
+        return affine_add_sym(out, op, 1);
+    }
+    if (op->kind != TEMP || nr_def > 1) {
+        return false;
+    }
+    Affine x, y;
+    if (def->kind == IR_ASSIGN) {
+        return eval_affine_rec(def->arg1, from, to,
+                levels, nr_level, out, depth + 1);
+    }
+    if (def->kind != IR_ADD && def->kind != IR_SUB && def->kind != IR_MUL) {
+        return false;
+    }
+    if (!eval_affine_rec(def->arg1, from, to, levels, nr_level, &x, depth + 1)
+            || !eval_affine_rec(def->arg2, from, to,
+                levels, nr_level, &y, depth + 1)) {
+        return false;
+    }
+    if (def->kind == IR_ADD) {
+        return affine_combine(out, &x, &y, 1);
+    } else if (def->kind == IR_SUB) {
+        return affine_combine(out, &x, &y, -1);
+    } else if (affine_is_const(&x)) {
+        affine_scale(&y, x.cst);
+        *out = y;
+        return true;
+    } else if (affine_is_const(&y)) {
+        affine_scale(&x, y.cst);
+        *out = x;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+// evaluate op in terms of the loop ivs, using the definitions in
+// [from, to); variables not defined there are symbolic invariants
+bool eval_affine(Operand *op, IRNode *from, IRNode *to,
+        LoopLevel *levels, int nr_level, Affine *out) {
+    return eval_affine_rec(op, from, to, levels, nr_level, out, 0);
+}
+
+static int gcd(int a, int b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// one dimension of the dependence equation:
+// sum a[k] * x_k - b[k] * y_k == rhs
+typedef struct {
+    bool analyzable;
+    int a[MAX_LEVEL];
+    int b[MAX_LEVEL];
+    int rhs;
+} Equation;
+
+static bool make_equation(Affine *fa, Affine *fb, int nr_level,
+        Equation *eq) {
+    Affine diff;
+    eq->analyzable = false;
+    if (!affine_combine(&diff, fa, fb, -1)) {
+        return false;
+    }
+    for (int j = 0; j < diff.nr_sym; j++) {
+        if (diff.sym_coef[j] != 0) {
+            return false;
+        }
+    }
+    for (int k = 0; k < nr_level; k++) {
+        eq->a[k] = fa->coef[k];
+        eq->b[k] = fb->coef[k];
+    }
+    eq->rhs = fb->cst - fa->cst;
+    eq->analyzable = true;
+    return true;
+}
+
+static bool gcd_test(Equation *eq, int nr_level) {
+    int g = 0;
+    for (int k = 0; k < nr_level; k++) {
+        g = gcd(g, eq->a[k]);
+        g = gcd(g, eq->b[k]);
+    }
+    if (g == 0) {
+        return eq->rhs == 0;
+    }
+    return eq->rhs % g == 0;
+}
+
+typedef struct {
+    bool empty;
+    bool bounded;
+    long long lo;
+    long long hi;
+} Range;
+
+static void range_add_point(Range *r, long long v) {
+    if (r->empty) {
+        r->empty = false;
+        r->lo = r->hi = v;
+    } else {
+        if (v < r->lo) r->lo = v;
+        if (v > r->hi) r->hi = v;
+    }
+}
+
+// is the first access (value x) able to run in an iteration with
+// the given direction to the second access (value y)?
+static bool level_feasible(LoopLevel *lv, int dir) {
+    if (dir == DIR_EQ || !lv->has_bounds) {
+        return true;
+    }
+    int g = lv->step < 0 ? -lv->step : lv->step;
+    return lv->upper - lv->lower >= g;
+}
+
+// range of a * x - b * y under the direction
+static Range term_range(int a, int b, LoopLevel *lv, int dir) {
+    Range r = { true, true, 0, 0 };
+    if (a == 0 && b == 0) {
+        r.empty = false;
+        return r;
+    }
+    if (dir == DIR_EQ && a == b) {
+        r.empty = false;
+        return r;
+    }
+    if (!lv->has_bounds) {
+        r.empty = false;
+        r.bounded = false;
+        return r;
+    }
+    long long L = lv->lower, U = lv->upper;
+    long long g = lv->step < 0 ? -lv->step : lv->step;
+    if (dir == DIR_EQ) {
+        range_add_point(&r, (a - b) * L);
+        range_add_point(&r, (a - b) * U);
+        return r;
+    }
+    // x < y in value when the first access is earlier and step > 0
+    bool x_less = (dir == DIR_LT) == (lv->step > 0);
+    long long xs[3], ys[3];
+    if (x_less) {
+        xs[0] = L; ys[0] = L + g;
+        xs[1] = L; ys[1] = U;
+        xs[2] = U - g; ys[2] = U;
+    } else {
+        xs[0] = L + g; ys[0] = L;
+        xs[1] = U; ys[1] = L;
+        xs[2] = U; ys[2] = U - g;
+    }
+    for (int i = 0; i < 3; i++) {
+        range_add_point(&r, a * xs[i] - b * ys[i]);
+    }
+    return r;
+}
+
+static bool banerjee_test(Equation *eq, LoopLevel *levels, int nr_level,
+        int *vector) {
+    long long lo = 0, hi = 0;
+    for (int k = 0; k < nr_level; k++) {
+        Range r = term_range(eq->a[k], eq->b[k], &levels[k], vector[k]);
+        if (!r.bounded) {
+            return true;
+        }
+        lo += r.lo;
+        hi += r.hi;
+    }
+    return lo <= eq->rhs && eq->rhs <= hi;
+}
+
+static void compute_distance(Equation *eqs, int nr_eq,
+        LoopLevel *levels, int nr_level, Dependence *dep) {
+    for (int k = 0; k < nr_level; k++) {
+        dep->distance_known[k] = false;
+    }
+    for (int i = 0; i < nr_eq; i++) {
+        Equation *eq = &eqs[i];
+        if (!eq->analyzable) {
+            continue;
+        }
+        int only = -1;
+        for (int k = 0; k < nr_level; k++) {
+            if (eq->a[k] != 0 || eq->b[k] != 0) {
+                only = (only == -1) ? k : -2;
+            }
+        }
+        if (only < 0 || eq->a[only] != eq->b[only]) {
+            continue;
+        }
+        // c * (x - y) == rhs, so y - x == -rhs / c
+        int c = eq->a[only] * levels[only].step;
+        if (eq->rhs % c != 0) {
+            continue;
+        }
+        dep->distance_known[only] = true;
+        dep->distance[only] = -eq->rhs / c;
+    }
+}
+
+// test whether the two accesses of the same array can touch the
+// same element, a's indices are evaluated in [a_from, a_to) and
+// b's in [b_from, b_to), both at the start of an iteration
+void test_dependence(ArrayRef *a, IRNode *a_from, IRNode *a_to,
+        ArrayRef *b, IRNode *b_from, IRNode *b_to,
+        LoopLevel *levels, int nr_level, Dependence *dep) {
+    Equation eqs[16];
+    int nr_eq = 0;
+    if (nr_level > MAX_LEVEL) {
+        nr_level = MAX_LEVEL;
+    }
+    dep->kind = DEP_EXISTS;
+    dep->nr_level = nr_level;
+    dep->nr_vector = 0;
+    if (a->nr_dim == b->nr_dim) {
+        for (int d = 0; d < a->nr_dim && nr_eq < 16; d++) {
+            Affine fa, fb;
+            Equation *eq = &eqs[nr_eq++];
+            eq->analyzable = false;
+            if (eval_affine(a->index[d], a_from, a_to, levels, nr_level, &fa)
+                    && eval_affine(b->index[d], b_from, b_to,
+                        levels, nr_level, &fb)) {
+                make_equation(&fa, &fb, nr_level, eq);
+            }
+            if (eq->analyzable && !gcd_test(eq, nr_level)) {
+                dep->kind = DEP_NONE;
+                return;
+            }
+        }
+    }
+
+    int vector[MAX_LEVEL];
+    int total = 1;
+    for (int k = 0; k < nr_level; k++) {
+        total *= 3;
+        dep->direction[k] = 0;
+    }
+    for (int n = 0; n < total; n++) {
+        int m = n;
+        bool feasible = true;
+        for (int k = 0; k < nr_level; k++) {
+            vector[k] = 1 << (m % 3);
+            m /= 3;
+            if (!level_feasible(&levels[k], vector[k])) {
+                feasible = false;
+            }
+        }
+        for (int i = 0; i < nr_eq && feasible; i++) {
+            if (eqs[i].analyzable
+                    && !banerjee_test(&eqs[i], levels, nr_level, vector)) {
+                feasible = false;
+            }
+        }
+        if (!feasible) {
+            continue;
+        }
+        for (int k = 0; k < nr_level; k++) {
+            dep->vector[dep->nr_vector][k] = vector[k];
+            dep->direction[k] |= vector[k];
+        }
+        dep->nr_vector++;
+    }
+    if (dep->nr_vector == 0) {
+        dep->kind = DEP_NONE;
+        return;
+    }
+    compute_distance(eqs, nr_eq, levels, nr_level, dep);
+}
+
+char *dep_repr(Dependence *dep) {
+    char *str = malloc(100);
+    memset(str, 0, 100);
+    if (dep->kind == DEP_NONE) {
+        sprintf(str, "none");
+        return str;
+    }
+    int off = 0;
+    off += sprintf(str + off, "(");
+    for (int k = 0; k < dep->nr_level; k++) {
+        int d = dep->direction[k];
+        off += sprintf(str + off, "%s%s%s%s",
+                k == 0 ? "" : ",",
+                d & DIR_LT ? "<" : "",
+                d & DIR_EQ ? "=" : "",
+                d & DIR_GT ? ">" : "");
+    }
+    off += sprintf(str + off, ") distance (");
+    for (int k = 0; k < dep->nr_level; k++) {
+        if (dep->distance_known[k]) {
+            off += sprintf(str + off, "%s%d", k == 0 ? "" : ",",
+                    dep->distance[k]);
+        } else {
+            off += sprintf(str + off, "%s?", k == 0 ? "" : ",");
+        }
+    }
+    off += sprintf(str + off, ")");
+    return str;
+}
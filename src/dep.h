@@ -0,0 +1,53 @@
+#ifndef __DEP_H__
+#define __DEP_H__
+
+#include "common.h"
+#include "ir.h"
+
+#define MAX_LEVEL 4
+#define MAX_SYM 8
+#define MAX_VECTOR 81
+
+#define DIR_LT 1
+#define DIR_EQ 2
+#define DIR_GT 4
+#define DIR_ALL (DIR_LT | DIR_EQ | DIR_GT)
+
+// a loop enclosing both accesses, outermost first
+typedef struct {
+    Operand *iv;
+    int step;
+    bool has_bounds;
+    int lower;  // inclusive range of the values of iv
+    int upper;
+} LoopLevel;
+
+// cst + sum coef[k] * iv_k + sum sym_coef[j] * sym[j]
+typedef struct {
+    int cst;
+    int coef[MAX_LEVEL];
+    int nr_sym;
+    Operand *sym[MAX_SYM];
+    int sym_coef[MAX_SYM];
+} Affine;
+
+typedef struct {
+    enum { DEP_NONE, DEP_EXISTS } kind;
+    int nr_level;
+    // directions are taken from the first access to the second one:
+    // DIR_LT means the first access runs in an earlier iteration
+    int direction[MAX_LEVEL];
+    bool distance_known[MAX_LEVEL];
+    int distance[MAX_LEVEL];
+    int nr_vector;
+    int vector[MAX_VECTOR][MAX_LEVEL];
+} Dependence;
+
+bool eval_affine(Operand *op, IRNode *from, IRNode *to,
+        LoopLevel *levels, int nr_level, Affine *out);
+void test_dependence(ArrayRef *a, IRNode *a_from, IRNode *a_to,
+        ArrayRef *b, IRNode *b_from, IRNode *b_to,
+        LoopLevel *levels, int nr_level, Dependence *dep);
+char *dep_repr(Dependence *dep);
+
+#endif
@@ -0,0 +1,34 @@
+#include "common.h"
+#include "ir.h"
+#include "callgraph.h"
+
+// dead function elimination: a function that no chain of calls from
+// main reaches is removed with its code
+
+static int nr_removed;
+
+// returns the number of functions removed
+int eliminate_dead_functions() {
+    info("eliminating dead functions...");
+    nr_removed = 0;
+    CallGraph *cg = newCallGraph();
+    if (cg->main == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *f = cg->funcs[i];
+        if (f->reachable) {
+            continue;
+        }
+        info("remove function %s", f->name);
+        IRNode *q = f->node;
+        while (q != f->end) {
+            IRNode *next = q->next;
+            IRList_remove(q);
+            q = next;
+        }
+        nr_removed++;
+    }
+    info("%d functions removed", nr_removed);
+    return nr_removed;
+}
@@ -0,0 +1,319 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "bitset.h"
+#include "alias.h"
+#include "vn.h"
+#include "modref.h"
+
+// dead store elimination: a store to a temp or variable is dead if the
+// value is not live after it, a store to a local array is dead if no
+// path reads the array afterwards, or if the same element is stored
+// again before any read of it
+
+extern int nr_temp;
+
+// liveness facts of a function: temps by number, then its variables;
+// a local allocation is live while the temp of its DEC is
+typedef struct {
+    int nr_var;
+    char **var_name;
+    int nr_bit;
+    int nr_alloc;
+    int *alloc;  // allocations in the function that do not escape
+} Universe;
+
+static int nr_removed;
+
+static void add_var(Universe *u, char *name) {
+    for (int i = 0; i < u->nr_var; i++) {
+        if (strcmp(u->var_name[i], name) == 0) {
+            return;
+        }
+    }
+    u->var_name = realloc(u->var_name, (u->nr_var + 1) * sizeof(char *));
+    u->var_name[u->nr_var++] = name;
+}
+
+static int var_index(Universe *u, char *name) {
+    for (int i = 0; i < u->nr_var; i++) {
+        if (strcmp(u->var_name[i], name) == 0) {
+            return nr_temp + 1 + i;
+        }
+    }
+    fatal("variable %s is not in the function", name);
+}
+
+static void collect_op(Universe *u, Operand *op) {
+    if (op == NULL) {
+        return;
+    }
+    if (op->kind == VAR_OPERAND) {
+        add_var(u, op->var_name);
+    } else if (op->kind == INDIR) {
+        collect_op(u, op->indir_var);
+    }
+}
+
+static Universe *newUniverse(CFG *cfg) {
+    Universe *u = malloc(sizeof(Universe));
+    u->nr_var = 0;
+    u->var_name = NULL;
+    u->nr_alloc = 0;
+    u->alloc = NULL;
+    for (IRNode *q = cfg->func->next; q != cfg->end; q = q->next) {
+        IR *ir = q->ir;
+        Operand **slots[MAX_READ_SLOT];
+        int n = ir_read_slots(ir, slots);
+        for (int i = 0; i < n; i++) {
+            collect_op(u, *slots[i]);
+        }
+        collect_op(u, ir_def(ir));
+        if (ir_store(ir) != NULL) {
+            collect_op(u, ir_store(ir));
+        }
+        if (ir->kind == IR_ALLOC
+                && !alloc_escapes(ir->alloc.var->temp_no)) {
+            u->alloc = realloc(u->alloc, (u->nr_alloc + 1) * sizeof(int));
+            u->alloc[u->nr_alloc++] = ir->alloc.var->temp_no;
+        }
+    }
+    u->nr_bit = nr_temp + 1 + u->nr_var;
+    return u;
+}
+
+static void use_op(Universe *u, Bitset *live, Operand *op) {
+    if (op->kind == TEMP) {
+        Bitset_set(live, op->temp_no);
+    } else if (op->kind == VAR_OPERAND) {
+        Bitset_set(live, var_index(u, op->var_name));
+    } else if (op->kind == INDIR) {
+        use_op(u, live, op->indir_var);
+        for (int i = 0; i < u->nr_alloc; i++) {
+            if (may_point_to(op->indir_var, u->alloc[i])) {
+                Bitset_set(live, u->alloc[i]);
+            }
+        }
+    }
+}
+
+static void use_globals(Universe *u, Bitset *live) {
+    for (int i = 0; i < u->nr_var; i++) {
+        if (is_global(u->var_name[i])) {
+            Bitset_set(live, nr_temp + 1 + i);
+        }
+    }
+}
+
+static void use_read_by_call(Universe *u, Bitset *live, IR *call) {
+    for (int i = 0; i < u->nr_var; i++) {
+        if (call_may_read(call, u->var_name[i])) {
+            Bitset_set(live, nr_temp + 1 + i);
+        }
+    }
+}
+
+static bool is_local_alloc(Universe *u, int alloc_no) {
+    for (int i = 0; i < u->nr_alloc; i++) {
+        if (u->alloc[i] == alloc_no) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_dead_store(Universe *u, Bitset *live, IR *ir) {
+    Operand *def = ir_def(ir);
+    if (def != NULL) {
+        if (ir->kind != IR_ASSIGN
+                && ir->kind != IR_ADD
+                && ir->kind != IR_SUB
+                && ir->kind != IR_MUL
+                && ir->kind != IR_DIV
+                && ir->kind != IR_CMP
+                && ir->kind != IR_SELECT
+                && ir->kind != IR_SHL
+                && ir->kind != IR_SHR
+                && ir->kind != IR_SHRU
+                && ir->kind != IR_MULH) {
+            return false;
+        }
+        int i = (def->kind == TEMP)
+            ? def->temp_no : var_index(u, def->var_name);
+        return !Bitset_test(live, i);
+    }
+    Operand *store = ir_store(ir);
+    if (store != NULL) {
+        int alloc_no = alloc_of(store->indir_var);
+        return is_local_alloc(u, alloc_no) && !Bitset_test(live, alloc_no);
+    }
+    return false;
+}
+
+// live is the set after ir, and becomes the set before it
+static void transfer(Universe *u, Bitset *live, IR *ir) {
+    Operand *def = ir_def(ir);
+    if (def != NULL) {
+        Bitset_unset(live, (def->kind == TEMP)
+                ? def->temp_no : var_index(u, def->var_name));
+    }
+    Operand **slots[MAX_READ_SLOT];
+    int n = ir_read_slots(ir, slots);
+    for (int i = 0; i < n; i++) {
+        use_op(u, live, *slots[i]);
+    }
+    Operand *store = ir_store(ir);
+    if (store != NULL) {
+        use_op(u, live, store->indir_var);
+    }
+    if (ir->kind == IR_CALL) {
+        use_read_by_call(u, live, ir);
+    } else if (ir->kind == IR_RETURN) {
+        use_globals(u, live);
+    }
+}
+
+static void live_out(Universe *u, Block *b, Bitset **live_in, Bitset *out) {
+    Bitset_clear(out);
+    if (b->nr_succ == 0) {
+        use_globals(u, out);
+    }
+    for (int i = 0; i < b->nr_succ; i++) {
+        Bitset_union(out, live_in[b->succ[i]->id]);
+    }
+}
+
+static bool remove_dead_stores(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    Universe *u = newUniverse(cfg);
+    Bitset **live_in = malloc((cfg->nr_block + 1) * sizeof(Bitset *));
+    for (int i = 0; i < cfg->nr_block; i++) {
+        live_in[i] = newBitset(u->nr_bit);
+    }
+    Bitset *live = newBitset(u->nr_bit);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = cfg->nr_block - 1; i >= 0; i--) {
+            Block *b = cfg->blocks[i];
+            live_out(u, b, live_in, live);
+            for (IRNode *q = b->last; q != b->first->prev; q = q->prev) {
+                transfer(u, live, q->ir);
+            }
+            if (!Bitset_equals(live, live_in[i])) {
+                Bitset_copy(live_in[i], live);
+                changed = true;
+            }
+        }
+    }
+
+    bool removed = false;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        live_out(u, b, live_in, live);
+        IRNode *stop = b->first->prev;
+        IRNode *q = b->last;
+        while (q != stop) {
+            IRNode *prev = q->prev;
+            if (is_dead_store(u, live, q->ir)) {
+                info("dead store: %s", ir_repr(q->ir));
+                IRList_remove(q);
+                nr_removed++;
+                removed = true;
+            } else {
+                transfer(u, live, q->ir);
+            }
+            q = prev;
+        }
+    }
+    return removed;
+}
+
+typedef struct {
+    IRNode *node;
+    Operand *addr;
+    int addr_vn;
+} Pending;
+
+// a store is dead if the same element is stored again in the block
+// before anything may read it
+static bool remove_overwritten_stores(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    Pending *pending = malloc((IRList_length() + 1) * sizeof(Pending));
+    bool removed = false;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        VNState *s = newVNState();
+        int nr_pending = 0;
+        IRNode *stop = b->last->next;
+        for (IRNode *q = b->first; q != stop; q = q->next) {
+            IR *ir = q->ir;
+            Operand **slots[MAX_READ_SLOT];
+            int n = ir_read_slots(ir, slots);
+            for (int j = 0; j < n; j++) {
+                Operand *op = *slots[j];
+                if (op->kind != INDIR) {
+                    continue;
+                }
+                int vn = vn_of(s, op->indir_var);
+                for (int k = nr_pending - 1; k >= 0; k--) {
+                    if (pending[k].addr_vn == vn
+                            || may_alias(pending[k].addr, op->indir_var)) {
+                        pending[k] = pending[--nr_pending];
+                    }
+                }
+            }
+            if (ir->kind == IR_CALL && call_reads_memory(ir)) {
+                for (int k = nr_pending - 1; k >= 0; k--) {
+                    if (call_may_access(pending[k].addr)) {
+                        pending[k] = pending[--nr_pending];
+                    }
+                }
+            }
+            Operand *store = ir_store(ir);
+            if (store != NULL) {
+                Operand *addr = store->indir_var;
+                int vn = vn_of(s, addr);
+                for (int k = nr_pending - 1; k >= 0; k--) {
+                    if (pending[k].addr_vn == vn
+                            || must_alias(pending[k].addr, addr)) {
+                        info("overwritten store: %s",
+                                ir_repr(pending[k].node->ir));
+                        IRList_remove(pending[k].node);
+                        nr_removed++;
+                        removed = true;
+                        pending[k] = pending[--nr_pending];
+                    }
+                }
+                pending[nr_pending].node = q;
+                pending[nr_pending].addr = addr;
+                pending[nr_pending].addr_vn = vn;
+                nr_pending++;
+            }
+            vn_update(s, ir);
+        }
+    }
+    return removed;
+}
+
+void eliminate_dead_stores() {
+    info("eliminating dead stores...");
+    alias_analyze();
+    nr_removed = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        vn_init();
+        for (IRNode *f = next_function(NULL); f != NULL;
+                f = next_function(f)) {
+            if (remove_dead_stores(f)) {
+                changed = true;
+            }
+            if (remove_overwritten_stores(f)) {
+                changed = true;
+            }
+        }
+    }
+    info("%d dead stores removed", nr_removed);
+}
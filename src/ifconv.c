@@ -0,0 +1,273 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+
+// if-conversion: a short branch over side effect free instructions,
+//
+//     IF a < b GOTO L1          IF a < b GOTO L
+//     (else arm)                (else arm)
+//     GOTO L2                   LABEL L
+//     LABEL L1
+//     (then arm)
+//     LABEL L2
+//
+// is replaced by computing both arms into new temps and selecting the
+// values with the result of `c := a < b'
+
+#define MAX_ARM_SIZE 4
+
+typedef struct {
+    Operand *def;
+    Operand *then_value;
+    Operand *else_value;
+} Selected;
+
+static int nr_converted;
+
+static bool can_speculate(IR *ir) {
+    if (ir->kind != IR_ASSIGN
+            && ir->kind != IR_ADD
+            && ir->kind != IR_SUB
+            && ir->kind != IR_MUL
+            && ir->kind != IR_CMP
+            && ir->kind != IR_SELECT) {
+        return false;
+    }
+    if (ir_def(ir) == NULL) {
+        return false;
+    }
+    Operand **slots[MAX_READ_SLOT];
+    int n = ir_read_slots(ir, slots);
+    for (int i = 0; i < n; i++) {
+        if ((*slots[i])->kind == INDIR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the number of instructions from q that can be speculated, or -1 if
+// there are more than MAX_ARM_SIZE of them
+static int arm_size(IRNode *q, IRNode *end) {
+    int n = 0;
+    for (; q != end && can_speculate(q->ir); q = q->next) {
+        if (++n > MAX_ARM_SIZE) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+static IRNode *skip(IRNode *q, int n) {
+    for (int i = 0; i < n; i++) {
+        q = q->next;
+    }
+    return q;
+}
+
+static int label_uses(IRNode *func, IRNode *end, int label_no) {
+    int n = 0;
+    for (IRNode *q = func->next; q != end; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_GOTO && label_number(ir->goto_.label) == label_no
+                || ir->kind == IR_IF
+                && label_number(ir->if_.label) == label_no) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static bool is_label(IRNode *q, IRNode *end, int label_no) {
+    return q != end && q->ir->kind == IR_LABEL
+        && q->ir->label.label_no == label_no;
+}
+
+// is op read outside of the nodes from first to last
+static bool used_outside(IRNode *func, IRNode *end, IRNode *first,
+        IRNode *last, Operand *op) {
+    bool inside = false;
+    for (IRNode *q = func->next; q != end; q = q->next) {
+        if (q == first) {
+            inside = true;
+        }
+        if (!inside && ir_contains(q->ir, op)) {
+            return true;
+        }
+        if (q == last) {
+            inside = false;
+        }
+    }
+    return false;
+}
+
+// copies already taken out of an arm have no IR
+static bool defined_in(IRNode *first, int n, Operand *op) {
+    IRNode *q = first;
+    for (int i = 0; i < n; i++, q = q->next) {
+        if (q->ir != NULL && op_equals(ir_def(q->ir), op)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Selected *find_selected(Selected *sel, int nr_sel, Operand *def) {
+    for (int i = 0; i < nr_sel; i++) {
+        if (op_equals(sel[i].def, def)) {
+            return &sel[i];
+        }
+    }
+    return NULL;
+}
+
+// rename the definitions of an arm to new temps, recording the value
+// of each definition at the end of the arm
+static int rename_arm(IRNode *first, int n, IRNode *other, int nr_other,
+        Selected *sel, int nr_sel, bool is_then) {
+    IRNode *q = first;
+    for (int i = 0; i < n; i++, q = q->next) {
+        IR *ir = q->ir;
+        Operand **slots[MAX_READ_SLOT];
+        int nr_slot = ir_read_slots(ir, slots);
+        for (int k = 0; k < nr_slot; k++) {
+            Selected *s = find_selected(sel, nr_sel, *slots[k]);
+            if (s != NULL) {
+                Operand *value = is_then ? s->then_value : s->else_value;
+                if (value != NULL) {
+                    *slots[k] = value;
+                }
+            }
+        }
+        Operand *def = ir_def(ir);
+        Selected *s = find_selected(sel, nr_sel, def);
+        if (s == NULL) {
+            s = &sel[nr_sel++];
+            s->def = def;
+            s->then_value = NULL;
+            s->else_value = NULL;
+        }
+        Operand *value;
+        Operand *arg = ir->arg1;
+        if (ir->kind == IR_ASSIGN
+                && (arg->kind == INT_LITERAL
+                    || !defined_in(first, n, arg)
+                    && !defined_in(other, nr_other, arg))) {
+            // a copy of a value that the arms do not change
+            value = arg;
+            q->ir = NULL;
+        } else {
+            value = newTemp();
+            ir->result = value;
+        }
+        if (is_then) {
+            s->then_value = value;
+        } else {
+            s->else_value = value;
+        }
+    }
+    return nr_sel;
+}
+
+static void remove_copies(IRNode *first, int n) {
+    IRNode *q = first;
+    for (int i = 0; i < n; i++) {
+        IRNode *next = q->next;
+        if (q->ir == NULL) {
+            IRList_remove(q);
+        }
+        q = next;
+    }
+}
+
+static bool convert(IRNode *func, IRNode *end, IRNode *branch) {
+    IR *ir = branch->ir;
+    IRNode *else_arm = branch->next;
+    int nr_else = arm_size(else_arm, end);
+    if (nr_else < 0) {
+        return false;
+    }
+    IRNode *after_else = skip(else_arm, nr_else);
+    int label_no = label_number(ir->if_.label);
+    IRNode *then_arm = NULL;
+    int nr_then = 0;
+    IRNode *join;
+    if (is_label(after_else, end, label_no)) {
+        // triangle
+        join = after_else;
+    } else if (after_else != end && after_else->ir->kind == IR_GOTO
+            && is_label(after_else->next, end, label_no)
+            && label_uses(func, end, label_no) == 1) {
+        // diamond
+        then_arm = after_else->next->next;
+        nr_then = arm_size(then_arm, end);
+        if (nr_then < 0) {
+            return false;
+        }
+        join = skip(then_arm, nr_then);
+        if (!is_label(join, end,
+                    label_number(after_else->ir->goto_.label))) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    if (nr_then + nr_else == 0) {
+        return false;
+    }
+
+    info("if-conversion of %s", ir_repr(ir));
+    Selected sel[2 * MAX_ARM_SIZE];
+    int nr_sel = 0;
+    nr_sel = rename_arm(else_arm, nr_else, then_arm, nr_then,
+            sel, nr_sel, false);
+    nr_sel = rename_arm(then_arm, nr_then, else_arm, nr_else,
+            sel, nr_sel, true);
+    if (then_arm != NULL) {
+        IRList_remove(after_else->next);
+        IRList_remove(after_else);
+    }
+    remove_copies(else_arm, nr_else);
+    remove_copies(then_arm, nr_then);
+
+    Operand *cond = newTemp();
+    branch->ir = newCmp(cond, ir->if_.arg1, ir->if_.relop, ir->if_.arg2);
+    // a temp only used in the arms needs no select
+    bool needed[2 * MAX_ARM_SIZE];
+    for (int i = 0; i < nr_sel; i++) {
+        needed[i] = sel[i].def->kind != TEMP
+            || used_outside(func, end, branch, join->prev, sel[i].def);
+    }
+    IRNode *q = join->prev;
+    for (int i = 0; i < nr_sel; i++) {
+        Operand *def = sel[i].def;
+        if (!needed[i]) {
+            continue;
+        }
+        Operand *then_value = sel[i].then_value;
+        Operand *else_value = sel[i].else_value;
+        q = IRList_insert_after(q, newSelect(def, cond,
+                    then_value != NULL ? then_value : def,
+                    else_value != NULL ? else_value : def));
+    }
+    nr_converted++;
+    return true;
+}
+
+// returns the number of branches removed
+int convert_ifs() {
+    info("converting branches to selects...");
+    nr_converted = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        IRNode *q = f->next;
+        while (q != next_function(f)) {
+            IRNode *next = q->next;
+            if (q->ir->kind == IR_IF && convert(f, next_function(f), q)) {
+                next = q->next;
+            }
+            q = next;
+        }
+    }
+    info("%d branches converted", nr_converted);
+    return nr_converted;
+}
@@ -0,0 +1,219 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "callgraph.h"
+#include "rename.h"
+
+// function inlining: a call to a small function that is not recursive
+// is replaced by a copy of its body with fresh temps and labels; the
+// arguments are copied to new temps where they are pushed, the
+// parameters are set from them at the start of the body, and each
+// `RETURN x' becomes a copy of x to the result and a jump past the body
+//
+// the variables of the callee keep their names: they live in static
+// storage like on a real call, and a function that is not recursive
+// has no two activations at a time
+
+// a callee of this size is inlined anywhere, a bigger one only in loops
+#define INLINE_SIZE 12
+#define LOOP_BONUS 12
+#define MAX_BONUS_DEPTH 3
+// a callee with a single call site in the program
+#define ONCE_SIZE 60
+#define MAX_CALLER_SIZE 600
+
+typedef struct {
+    IRNode *call;
+    int nr_arg;
+    IRNode **args;  // the ARG nodes, for the first parameter first
+    int depth;      // loop depth of the call
+} CallSite;
+
+extern IRList irList;
+
+static int nr_inlined;
+
+static int function_size(Function *f) {
+    int size = 0;
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        int kind = q->ir->kind;
+        if (kind != IR_LABEL && kind != IR_PARAM) {
+            size++;
+        }
+    }
+    return size;
+}
+
+// pair each CALL with its ARG nodes by replaying the pushes and the
+// pops of the argument stack
+static int find_call_sites(CallGraph *cg, Function *f, CallSite **sites) {
+    int nr_site = 0;
+    *sites = malloc((f->nr_call + 1) * sizeof(CallSite));
+    int nr_stack = 0;
+    IRNode **stack = NULL;
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_ARG) {
+            stack = realloc(stack, (nr_stack + 1) * sizeof(IRNode *));
+            stack[nr_stack++] = q;
+        } else if (ir->kind == IR_CALL) {
+            int n = nr_params(callee_of(cg, ir));
+            if (n > nr_stack) {
+                // the arguments are not where expected
+                return 0;
+            }
+            CallSite *site = &(*sites)[nr_site++];
+            site->call = q;
+            site->nr_arg = n;
+            site->args = malloc((n + 1) * sizeof(IRNode *));
+            for (int i = 0; i < n; i++) {
+                site->args[i] = stack[--nr_stack];
+            }
+            site->depth = 0;
+        }
+    }
+    return nr_site;
+}
+
+static void find_depths(Function *f, CallSite *sites, int nr_site) {
+    CFG *cfg = newCFG(f->node);
+    if (cfg->nr_block == 0) {
+        return;
+    }
+    compute_dominators(cfg);
+    Loop *loops;
+    find_loops(cfg, &loops);
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+            for (int k = 0; k < nr_site; k++) {
+                if (sites[k].call == q) {
+                    sites[k].depth = b->loop_depth;
+                }
+            }
+        }
+    }
+}
+
+static int nr_reads(Function *f, Operand *op) {
+    int n = 0;
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        Operand **slots[MAX_READ_SLOT];
+        int k = ir_read_slots(q->ir, slots);
+        for (int i = 0; i < k; i++) {
+            if (op_equals(*slots[i], op)) {
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static int nr_defs(Function *f, Operand *op) {
+    int n = 0;
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        Operand *def = ir_def(q->ir);
+        if (def != NULL && op_equals(def, op)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static void inline_call(Function *caller, Function *callee, CallSite *site) {
+    IRNode *call = site->call;
+    Operand *result = call->ir->result;
+    info("inline %s into a call at depth %d", callee->name, site->depth);
+    Renaming *r = newRenaming();
+
+    // the arguments are evaluated where they were pushed; a parameter
+    // that the callee only reads stands for the value itself, as long as
+    // a temp still has a single use afterwards
+    IRNode *q = callee->node->next;
+    for (int i = 0; i < site->nr_arg; i++, q = q->next) {
+        IRNode *arg = site->args[i];
+        Operand *param = q->ir->arg1;
+        Operand *value = arg->ir->arg1;
+        bool plain = is_plain_param(callee, param);
+        bool once = plain && nr_reads(callee, param) <= 1;
+        if (plain && value->kind == INT_LITERAL
+                || once && value->kind == TEMP && nr_defs(caller, value) == 1) {
+            rename_var(r, param->var_name, value);
+            IRList_remove(arg);
+            continue;
+        }
+        Operand *temp = newTemp();
+        arg->ir = newAssign(temp, value);
+        if (once) {
+            rename_var(r, param->var_name, temp);
+        } else {
+            IRList_insert_before(call, newAssign(param, temp));
+        }
+    }
+    Label *end = newLabel();
+    for (; q != callee->end; q = q->next) {
+        IR *ir = rename_ir(r, q->ir);
+        if (ir->kind == IR_RETURN) {
+            if (result != NULL) {
+                IRList_insert_before(call, newAssign(result, ir->arg1));
+            }
+            IRList_insert_before(call, newGoto(end));
+        } else {
+            IRList_insert_before(call, ir);
+        }
+    }
+    call->ir = newLabelIR(end);
+    nr_inlined++;
+}
+
+// the calls made so far are counted, with those in inlined copies
+static int nr_sites_of(Function *callee) {
+    int n = 0;
+    for (IRNode *q = irList.head; q != NULL; q = q->next) {
+        if (q->ir->kind == IR_CALL
+                && strcmp(q->ir->arg1->sym_name, callee->name) == 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static bool should_inline(CallGraph *cg, Function *caller, Function *callee,
+        CallSite *site) {
+    if (callee->recursive || callee == cg->main || callee == caller
+            || site->nr_arg != nr_params(callee)) {
+        return false;
+    }
+    int size = function_size(callee);
+    if (function_size(caller) + size > MAX_CALLER_SIZE) {
+        return false;
+    }
+    int depth = site->depth < MAX_BONUS_DEPTH ? site->depth : MAX_BONUS_DEPTH;
+    if (size <= INLINE_SIZE + LOOP_BONUS * depth) {
+        return true;
+    }
+    return size <= ONCE_SIZE && nr_sites_of(callee) == 1;
+}
+
+void inline_functions() {
+    info("inlining functions...");
+    nr_inlined = 0;
+    CallGraph *cg = newCallGraph();
+    // callees first, so that what is inlined is already inlined into
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *f = cg->bottom_up[i];
+        if (!f->reachable || f->nr_call == 0) {
+            continue;
+        }
+        CallSite *sites;
+        int nr_site = find_call_sites(cg, f, &sites);
+        find_depths(f, sites, nr_site);
+        for (int k = 0; k < nr_site; k++) {
+            Function *callee = callee_of(cg, sites[k].call->ir);
+            if (should_inline(cg, f, callee, &sites[k])) {
+                inline_call(f, callee, &sites[k]);
+            }
+        }
+    }
+    info("%d calls inlined", nr_inlined);
+}
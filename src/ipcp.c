@@ -0,0 +1,392 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "range.h"
+#include "callgraph.h"
+#include "rename.h"
+
+// interprocedural constant propagation: a parameter that gets the same
+// constant at every call site that may run, as the value ranges in the
+// callers tell, is replaced with the constant, and so is the result of
+// a call to a function that returns the same constant everywhere; this
+// is repeated, as each step can make more arguments constant
+//
+// a function called with a constant argument in a loop, or for a
+// parameter it branches on, while the argument differs at other sites,
+// gets a specialized copy for those sites, within a budget of copied
+// instructions; the copy keeps the variables of the function, which
+// live in static storage and are not used by two activations at a time
+// as the function is not recursive
+
+#define MAX_ROUNDS 4
+#define MAX_SPECIALIZE_SIZE 80
+#define SPECIALIZE_BUDGET 200
+
+typedef struct {
+    Function *func;
+    int nr_param;
+    bool *known;
+    int *values;
+    char *name;
+    int nr_site;
+    IRNode **sites;  // the calls to retarget
+} Specialization;
+
+extern IRList irList;
+
+static CallGraph *cg;
+static RangeInfo **infos;  // by function id, computed when needed
+static int nr_propagated;
+static int nr_specialized;
+
+static RangeInfo *ranges_of(Function *f) {
+    if (infos[f->id] == NULL) {
+        infos[f->id] = compute_ranges(newCFG(f->node));
+    }
+    return infos[f->id];
+}
+
+static void start_round() {
+    cg = newCallGraph();
+    infos = malloc((cg->nr_func + 1) * sizeof(RangeInfo *));
+    for (int i = 0; i < cg->nr_func; i++) {
+        infos[i] = NULL;
+    }
+}
+
+static bool is_constant(Range r, int *value) {
+    if (r.lo != r.hi) {
+        return false;
+    }
+    *value = (int) r.lo;
+    return true;
+}
+
+static IRNode *param_node(Function *f, int i) {
+    IRNode *q = f->node->next;
+    while (i-- > 0) {
+        q = q->next;
+    }
+    return q;
+}
+
+// the constant passed for the i-th parameter at every call site
+static bool constant_param(Function *g, int i, int *value) {
+    int nr_site = 0;
+    for (int k = 0; k < g->nr_caller; k++) {
+        Function *f = g->callers[k];
+        if (!f->reachable) {
+            continue;
+        }
+        for (int j = 0; j < f->nr_call; j++) {
+            IRNode *call = f->calls[j];
+            if (callee_of(cg, call->ir) != g
+                    || !is_reached(ranges_of(f), call)) {
+                continue;
+            }
+            int nr_pending;
+            IRNode **args = find_args(cg, f, call, &nr_pending);
+            int v;
+            if (args == NULL || !is_constant(range_before(ranges_of(f),
+                            args[i], args[i]->ir->arg1), &v)
+                    || nr_site > 0 && v != *value) {
+                return false;
+            }
+            *value = v;
+            nr_site++;
+        }
+    }
+    return nr_site > 0;
+}
+
+// the constant returned by every RETURN that may run
+static bool constant_return(Function *g, int *value) {
+    int nr_return = 0;
+    for (IRNode *q = g->node->next; q != g->end; q = q->next) {
+        if (q->ir->kind != IR_RETURN || !is_reached(ranges_of(g), q)) {
+            continue;
+        }
+        int v;
+        if (!is_constant(range_before(ranges_of(g), q, q->ir->arg1), &v)
+                || nr_return > 0 && v != *value) {
+            return false;
+        }
+        *value = v;
+        nr_return++;
+    }
+    return nr_return > 0;
+}
+
+static int replace_reads(Function *f, Operand *op, Operand *repl) {
+    int n = 0;
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        Operand **slots[MAX_READ_SLOT];
+        int k = ir_read_slots(q->ir, slots);
+        for (int i = 0; i < k; i++) {
+            if (op_equals(*slots[i], op)) {
+                *slots[i] = repl;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static bool is_read(Function *f, Operand *op) {
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        if (ir_contains(q->ir, op)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_used(Function *f, Operand *temp) {
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        Operand *store = ir_store(q->ir);
+        if (ir_contains(q->ir, temp)
+                || store != NULL && op_contains(store->indir_var, temp)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the call keeps its effects, its result is replaced with the constant
+static int replace_results(Function *g, int value) {
+    int n = 0;
+    for (int k = 0; k < g->nr_caller; k++) {
+        Function *f = g->callers[k];
+        for (int j = 0; j < f->nr_call; j++) {
+            IRNode *call = f->calls[j];
+            Operand *result = call->ir->result;
+            if (callee_of(cg, call->ir) != g || result == NULL
+                    || result->kind == TEMP && !is_used(f, result)) {
+                continue;
+            }
+            info("result of %s is #%d", ir_repr(call->ir), value);
+            call->ir->result = newTemp();
+            IRList_insert_after(call, newAssignInt(result, value));
+            n++;
+        }
+    }
+    return n;
+}
+
+static int propagate_round() {
+    start_round();
+    int nr_changed = 0;
+    int *values = malloc((cg->nr_func + 1) * sizeof(int));
+    bool *returns = malloc((cg->nr_func + 1) * sizeof(bool));
+    // all is decided from the ranges before anything is changed
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *g = cg->funcs[i];
+        returns[i] = g != cg->main && g->reachable
+            && constant_return(g, &values[i]);
+    }
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *g = cg->funcs[i];
+        if (g == cg->main || !g->reachable) {
+            continue;
+        }
+        int n = nr_params(g);
+        bool *known = malloc((n + 1) * sizeof(bool));
+        int *consts = malloc((n + 1) * sizeof(int));
+        for (int k = 0; k < n; k++) {
+            Operand *param = param_node(g, k)->ir->arg1;
+            known[k] = is_plain_param(g, param)
+                && constant_param(g, k, &consts[k]);
+        }
+        for (int k = 0; k < n; k++) {
+            Operand *param = param_node(g, k)->ir->arg1;
+            if (known[k] && replace_reads(g, param,
+                        newIntLiteral(consts[k])) > 0) {
+                info("parameter %s of %s is #%d",
+                        param->var_name, g->name, consts[k]);
+                nr_changed++;
+            }
+        }
+    }
+    for (int i = 0; i < cg->nr_func; i++) {
+        if (returns[i]) {
+            nr_changed += replace_results(cg->funcs[i], values[i]);
+        }
+    }
+    return nr_changed;
+}
+
+static int function_size(Function *f) {
+    int size = 0;
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        if (q->ir->kind != IR_LABEL && q->ir->kind != IR_PARAM) {
+            size++;
+        }
+    }
+    return size;
+}
+
+static bool branches_on(Function *f, Operand *param) {
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_IF && (op_equals(ir->if_.arg1, param)
+                    || op_equals(ir->if_.arg2, param))
+                || ir->kind == IR_CMP && (op_equals(ir->arg1, param)
+                    || op_equals(ir->arg2, param))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int depth_of(CFG *cfg, IRNode *call) {
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+            if (q == call) {
+                return b->loop_depth;
+            }
+        }
+    }
+    return 0;
+}
+
+static char *copy_name(Function *g) {
+    static int nr_copy = 0;
+    char *name = malloc(strlen(g->name) + 20);
+    do {
+        sprintf(name, "%s_%d", g->name, ++nr_copy);
+    } while (find_function(cg, name) != NULL);
+    return name;
+}
+
+// a copy of g after it, with the known parameters replaced
+static void make_copy(Specialization *s) {
+    Function *g = s->func;
+    info("specialize %s as %s", g->name, s->name);
+    Renaming *r = newRenaming();
+    for (int k = 0; k < s->nr_param; k++) {
+        if (s->known[k]) {
+            rename_var(r, param_node(g, k)->ir->arg1->var_name,
+                    newIntLiteral(s->values[k]));
+        }
+    }
+    IRNode *last = g->end == NULL ? irList.tail : g->end->prev;
+    IRNode *pos = IRList_insert_after(last, newFunction(s->name));
+    for (IRNode *q = g->node->next; q != last->next; q = q->next) {
+        pos = IRList_insert_after(pos, rename_ir(r, q->ir));
+    }
+}
+
+static Specialization *find_specialization(Specialization *specs, int n,
+        Function *g, bool *known, int *values) {
+    for (int i = 0; i < n; i++) {
+        Specialization *s = &specs[i];
+        if (s->func != g) {
+            continue;
+        }
+        bool same = true;
+        for (int k = 0; k < s->nr_param; k++) {
+            if (s->known[k] != known[k]
+                    || known[k] && s->values[k] != values[k]) {
+                same = false;
+            }
+        }
+        if (same) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void specialize() {
+    start_round();
+    int budget = SPECIALIZE_BUDGET;
+    int nr_spec = 0;
+    Specialization *specs = NULL;
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *f = cg->funcs[i];
+        if (!f->reachable || f->nr_call == 0) {
+            continue;
+        }
+        CFG *cfg = newCFG(f->node);
+        compute_dominators(cfg);
+        Loop *loops;
+        find_loops(cfg, &loops);
+        for (int j = 0; j < f->nr_call; j++) {
+            IRNode *call = f->calls[j];
+            Function *g = callee_of(cg, call->ir);
+            int size = function_size(g);
+            int nr_pending;
+            IRNode **args = find_args(cg, f, call, &nr_pending);
+            if (g == cg->main || g->recursive || size > MAX_SPECIALIZE_SIZE
+                    || args == NULL || !is_reached(ranges_of(f), call)) {
+                continue;
+            }
+            int n = nr_params(g);
+            bool *known = malloc((n + 1) * sizeof(bool));
+            int *values = malloc((n + 1) * sizeof(int));
+            bool hot = false;
+            for (int k = 0; k < n; k++) {
+                Operand *param = param_node(g, k)->ir->arg1;
+                known[k] = is_plain_param(g, param) && is_read(g, param)
+                    && is_constant(range_before(ranges_of(f), args[k],
+                                args[k]->ir->arg1), &values[k]);
+                if (known[k] && (depth_of(cfg, call) > 0
+                            || branches_on(g, param))) {
+                    hot = true;
+                }
+            }
+            if (!hot) {
+                continue;
+            }
+            Specialization *s =
+                find_specialization(specs, nr_spec, g, known, values);
+            if (s == NULL) {
+                if (size > budget) {
+                    continue;
+                }
+                budget -= size;
+                specs = realloc(specs,
+                        (nr_spec + 1) * sizeof(Specialization));
+                s = &specs[nr_spec++];
+                s->func = g;
+                s->nr_param = n;
+                s->known = known;
+                s->values = values;
+                s->name = copy_name(g);
+                s->nr_site = 0;
+                s->sites = NULL;
+            }
+            s->sites = realloc(s->sites, (s->nr_site + 1) * sizeof(IRNode *));
+            s->sites[s->nr_site++] = call;
+        }
+    }
+    // the call graph must stay as it is until all calls are decided
+    for (int i = 0; i < nr_spec; i++) {
+        Specialization *s = &specs[i];
+        for (int k = 0; k < s->nr_site; k++) {
+            IRNode *call = s->sites[k];
+            call->ir = newCall(call->ir->result, s->name);
+            nr_specialized++;
+        }
+    }
+    for (int i = 0; i < nr_spec; i++) {
+        make_copy(&specs[i]);
+    }
+}
+
+void propagate_call_constants() {
+    info("propagating constants over calls...");
+    nr_propagated = 0;
+    nr_specialized = 0;
+    for (int round = 0; round < MAX_ROUNDS; round++) {
+        int n = propagate_round();
+        nr_propagated += n;
+        if (n == 0) {
+            break;
+        }
+    }
+    specialize();
+    info("%d constants propagated, %d calls specialized",
+            nr_propagated, nr_specialized);
+}
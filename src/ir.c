@@ -9,7 +9,8 @@ char *relop_repr(int relop);
 
 #define new_op(o, kkind) \
     Operand * o = malloc(sizeof(Operand)); \
-    o->kind = kkind
+    o->kind = kkind; \
+    o->array_ref = NULL
 #define new_ir(ir, kkind) \
     IR * ir = malloc(sizeof(IR)); \
     ir->kind = kkind
@@ -21,6 +22,32 @@ char *relop_repr(int relop);
 
 int nr_temp = 0;
 
+static int nr_global = 0;
+static char **globals = NULL;
+
+void declare_global(char *name) {
+    globals = realloc(globals, (nr_global + 1) * sizeof(char *));
+    globals[nr_global++] = name;
+}
+
+void undeclare_global(char *name) {
+    for (int i = 0; i < nr_global; i++) {
+        if (strcmp(globals[i], name) == 0) {
+            globals[i] = globals[--nr_global];
+            return;
+        }
+    }
+}
+
+bool is_global(char *name) {
+    for (int i = 0; i < nr_global; i++) {
+        if (strcmp(globals[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 Operand *newTemp() {
     new_op(temp, TEMP);
     temp->temp_no = ++nr_temp;
@@ -63,6 +90,24 @@ Operand *newIndir(Operand *var) {
     return o;
 }
 
+ArrayRef *newArrayRef() {
+    ArrayRef *ref = malloc(sizeof(ArrayRef));
+    ref->base = NULL;
+    ref->nr_dim = 0;
+    ref->index = NULL;
+    ref->width = NULL;
+    return ref;
+}
+
+void ArrayRef_add_dim(ArrayRef *ref, Operand *index, int width) {
+    int n = ref->nr_dim + 1;
+    ref->index = realloc(ref->index, n * sizeof(Operand *));
+    ref->width = realloc(ref->width, n * sizeof(int));
+    ref->index[n-1] = index;
+    ref->width[n-1] = width;
+    ref->nr_dim = n;
+}
+
 char *op_repr(Operand *op) {
     if (op == NULL) {
         warn("op == NULL");
@@ -157,6 +202,16 @@ Label *newLabel() {
     return l;
 }
 
+Label *label_of(int label_no) {
+    Label *l = malloc(sizeof(Label));
+    l->label_no = label_no;
+    return l;
+}
+
+int label_number(Label *label) {
+    return label->label_no;
+}
+
 char *label_repr(Label *label) {
     char *str = malloc(100);
     memset(str, 0, 100);
@@ -224,6 +279,39 @@ char *ir_repr(IR *ir) {
         off += sprintf(str + off, "READ %s", op_repr(ir->arg1));
     } else if (ir->kind == IR_WRITE) {
         off += sprintf(str + off, "WRITE %s", op_repr(ir->arg1));
+    } else if (ir->kind == IR_CMP) {
+        off += sprintf(str + off, "%s := %s %s %s",
+                op_repr(ir->result),
+                op_repr(ir->arg1),
+                relop_repr(ir->relop),
+                op_repr(ir->arg2));
+    } else if (ir->kind == IR_SELECT) {
+        off += sprintf(str + off, "%s := %s ? %s : %s",
+                op_repr(ir->result),
+                op_repr(ir->cond),
+                op_repr(ir->arg1),
+                op_repr(ir->arg2));
+    } else if (ir->kind == IR_SHL) {
+        off += sprintf(str + off, "%s := %s << %s",
+                op_repr(ir->result),
+                op_repr(ir->arg1),
+                op_repr(ir->arg2));
+    } else if (ir->kind == IR_SHR) {
+        off += sprintf(str + off, "%s := %s >> %s",
+                op_repr(ir->result),
+                op_repr(ir->arg1),
+                op_repr(ir->arg2));
+    } else if (ir->kind == IR_SHRU) {
+        off += sprintf(str + off, "%s := %s >>> %s",
+                op_repr(ir->result),
+                op_repr(ir->arg1),
+                op_repr(ir->arg2));
+    } else if (ir->kind == IR_MULH) {
+        // the high word of the signed product
+        off += sprintf(str + off, "%s := %s *h %s",
+                op_repr(ir->result),
+                op_repr(ir->arg1),
+                op_repr(ir->arg2));
     } else {
         off += sprintf(str + off, "some-ir");
     }
@@ -265,11 +353,106 @@ bool ir_contains(IR *ir, Operand *op) {
         return false;
     } else if (ir->kind == IR_WRITE) {
         return op_contains(ir->arg1, op);
+    } else if (ir->kind == IR_CMP
+            || ir->kind == IR_SHL
+            || ir->kind == IR_SHR
+            || ir->kind == IR_SHRU
+            || ir->kind == IR_MULH) {
+        return op_contains(ir->arg1, op) || op_contains(ir->arg2, op);
+    } else if (ir->kind == IR_SELECT) {
+        return op_contains(ir->cond, op)
+            || op_contains(ir->arg1, op)
+            || op_contains(ir->arg2, op);
     } else {
         return false;
     }
 }
 
+Operand *ir_def(IR *ir) {
+    // return the variable or temp written by ir, NULL if none
+    Operand *def = NULL;
+    if (ir->kind == IR_ASSIGN
+            || ir->kind == IR_ADD
+            || ir->kind == IR_SUB
+            || ir->kind == IR_MUL
+            || ir->kind == IR_DIV
+            || ir->kind == IR_CMP
+            || ir->kind == IR_SELECT
+            || ir->kind == IR_SHL
+            || ir->kind == IR_SHR
+            || ir->kind == IR_SHRU
+            || ir->kind == IR_MULH
+            || ir->kind == IR_CALL) {
+        def = ir->result;
+    } else if (ir->kind == IR_READ
+            || ir->kind == IR_PARAM) {
+        def = ir->arg1;
+    }
+    if (def == NULL 
+            || (def->kind != TEMP && def->kind != VAR_OPERAND)) {
+        return NULL;
+    }
+    return def;
+}
+
+// the slots of the operands read by ir, returns the number of slots
+int ir_read_slots(IR *ir, Operand **slots[]) {
+    if (ir->kind == IR_ASSIGN
+            || ir->kind == IR_RETURN
+            || ir->kind == IR_ARG
+            || ir->kind == IR_WRITE) {
+        slots[0] = &ir->arg1;
+        return 1;
+    } else if (ir->kind == IR_ADD
+            || ir->kind == IR_SUB
+            || ir->kind == IR_MUL
+            || ir->kind == IR_DIV
+            || ir->kind == IR_CMP
+            || ir->kind == IR_SHL
+            || ir->kind == IR_SHR
+            || ir->kind == IR_SHRU
+            || ir->kind == IR_MULH) {
+        slots[0] = &ir->arg1;
+        slots[1] = &ir->arg2;
+        return 2;
+    } else if (ir->kind == IR_IF) {
+        slots[0] = &ir->if_.arg1;
+        slots[1] = &ir->if_.arg2;
+        return 2;
+    } else if (ir->kind == IR_SELECT) {
+        slots[0] = &ir->cond;
+        slots[1] = &ir->arg1;
+        slots[2] = &ir->arg2;
+        return 3;
+    } else {
+        return 0;
+    }
+}
+
+Operand *ir_store(IR *ir) {
+    // return the `*p' written by ir, NULL if none
+    if (ir->kind == IR_ASSIGN && ir->result->kind == INDIR) {
+        return ir->result;
+    }
+    return NULL;
+}
+
+int invert_relop(int relop) {
+    if (relop == RELOP_LT) {
+        return RELOP_GE;
+    } else if (relop == RELOP_LE) {
+        return RELOP_GT;
+    } else if (relop == RELOP_GT) {
+        return RELOP_LE;
+    } else if (relop == RELOP_GE) {
+        return RELOP_LT;
+    } else if (relop == RELOP_EQ) {
+        return RELOP_NE;
+    } else {
+        return RELOP_EQ;
+    }
+}
+
 IR *newLabelIR(Label *label) {
     new_ir(ir, IR_LABEL);
     ir->label.label_no = label->label_no;
@@ -335,6 +518,63 @@ IR *newDiv(Operand *result, Operand *arg1, Operand *arg2) {
     return ir;
 }
 
+IR *newCmp(Operand *result, Operand *arg1, int relop, Operand *arg2) {
+    new_ir(ir, IR_CMP);
+    ir->result = result;
+    ir->arg1 = arg1;
+    ir->relop = relop;
+    ir->arg2 = arg2;
+    return ir;
+}
+
+IR *newSelect(Operand *result, Operand *cond, Operand *arg1, Operand *arg2) {
+    new_ir(ir, IR_SELECT);
+    ir->result = result;
+    ir->cond = cond;
+    ir->arg1 = arg1;
+    ir->arg2 = arg2;
+    return ir;
+}
+
+IR *newShl(Operand *result, Operand *arg1, Operand *arg2) {
+    new_ir(ir, IR_SHL);
+    ir->result = result;
+    ir->arg1 = arg1;
+    ir->arg2 = arg2;
+    return ir;
+}
+
+IR *newShr(Operand *result, Operand *arg1, Operand *arg2) {
+    new_ir(ir, IR_SHR);
+    ir->result = result;
+    ir->arg1 = arg1;
+    ir->arg2 = arg2;
+    return ir;
+}
+
+IR *newShru(Operand *result, Operand *arg1, Operand *arg2) {
+    new_ir(ir, IR_SHRU);
+    ir->result = result;
+    ir->arg1 = arg1;
+    ir->arg2 = arg2;
+    return ir;
+}
+
+IR *newMulh(Operand *result, Operand *arg1, Operand *arg2) {
+    new_ir(ir, IR_MULH);
+    ir->result = result;
+    ir->arg1 = arg1;
+    ir->arg2 = arg2;
+    return ir;
+}
+
+// the operands are shared with ir
+IR *copy_ir(IR *ir) {
+    new_ir(copy, ir->kind);
+    *copy = *ir;
+    return copy;
+}
+
 IR *newGoto(Label *label) {
     new_ir(ir, IR_GOTO);
     ir->goto_.label = label;
@@ -450,6 +690,34 @@ void IRList_remove(IRNode *irNode) {
     irList.length -= 1;
 }
 
+IRNode *IRList_insert_before(IRNode *pos, IR *ir) {
+    new_ir_node(irNode, ir);
+    irNode->prev = pos->prev;
+    irNode->next = pos;
+    if (pos->prev == NULL) {
+        irList.head = irNode;
+    } else {
+        pos->prev->next = irNode;
+    }
+    pos->prev = irNode;
+    irList.length += 1;
+    return irNode;
+}
+
+IRNode *IRList_insert_after(IRNode *pos, IR *ir) {
+    new_ir_node(irNode, ir);
+    irNode->prev = pos;
+    irNode->next = pos->next;
+    if (pos->next == NULL) {
+        irList.tail = irNode;
+    } else {
+        pos->next->prev = irNode;
+    }
+    pos->next = irNode;
+    irList.length += 1;
+    return irNode;
+}
+
 void IRList_print_to_file(FILE *file) {
     for (IRNode *q = irList.head; q != NULL; q = q->next) {
         IR *ir = q->ir;
@@ -4,9 +4,12 @@
 typedef struct Label_ Label;
 
 Label *newLabel();
+Label *label_of(int label_no);
+int label_number(Label *label);
 char *label_repr(Label *label);
 
 typedef struct Operand_ Operand;
+typedef struct ArrayRef_ ArrayRef;
 
 struct Operand_ {
     enum { 
@@ -27,8 +30,22 @@ struct Operand_ {
         Operand *addr_var;
         Operand *indir_var;
     };
+    // for INDIR produced by a subscript, may be NULL
+    ArrayRef *array_ref;
 };
 
+// the subscript structure of an array access `base[i1][i2]...'
+struct ArrayRef_ {
+    Operand *base;
+    int nr_dim;
+    Operand **index;  // index value of each dimension, outermost first
+    int *width;       // element width of each dimension
+};
+
+void declare_global(char *name);
+void undeclare_global(char *name);
+bool is_global(char *name);
+
 Operand *newTemp();
 Operand *newVariableOperand(char *name);
 Operand *newIntLiteral(int value);
@@ -36,6 +53,9 @@ Operand *newFloatLiteral(float value);
 Operand *newAddr(Operand *var);
 Operand *newIndir(Operand *indir);
 
+ArrayRef *newArrayRef();
+void ArrayRef_add_dim(ArrayRef *ref, Operand *index, int width);
+
 char *op_repr(Operand *op);
 char *var_repr(Operand *op);
 bool op_equals(Operand *, Operand *);
@@ -61,16 +81,25 @@ struct IR_ {
         IR_PARAM,
         IR_READ,
         IR_WRITE,
+        IR_CMP,
+        IR_SELECT,
+        IR_SHL,
+        IR_SHR,
+        IR_SHRU,
+        IR_MULH,
     } kind;
     union {
         /* for ASSIGN, ADD, SUB, MUL, DIV,
          * RETURN, ARG, CALL, PARAM,
-         * READ, WRITE
+         * READ, WRITE, CMP, SELECT,
+         * SHL, SHR, SHRU, MULH
          */
         struct {
             Operand *result;
             Operand *arg1;
             Operand *arg2;
+            int relop;  // for CMP
+            Operand *cond;  // for SELECT
         };
         // for FUNCTION
         struct {
@@ -101,6 +130,11 @@ struct IR_ {
 
 char *ir_repr(IR *ir);
 bool ir_contains(IR *ir, Operand *op);
+Operand *ir_def(IR *ir);
+Operand *ir_store(IR *ir);
+#define MAX_READ_SLOT 3
+int ir_read_slots(IR *ir, Operand **slots[]);
+int invert_relop(int relop);
 
 IR *newLabelIR(Label *label);
 IR *newFunction(char *name);
@@ -120,6 +154,13 @@ IR *newCall(Operand *result, char *name);
 IR *newParam(char *name);
 IR *newRead(Operand *arg1);
 IR *newWrite(Operand *arg1);
+IR *newCmp(Operand *result, Operand *arg1, int relop, Operand *arg2);
+IR *newSelect(Operand *result, Operand *cond, Operand *arg1, Operand *arg2);
+IR *newShl(Operand *result, Operand *arg1, Operand *arg2);
+IR *newShr(Operand *result, Operand *arg1, Operand *arg2);
+IR *newShru(Operand *result, Operand *arg1, Operand *arg2);
+IR *newMulh(Operand *result, Operand *arg1, Operand *arg2);
+IR *copy_ir(IR *ir);
 
 typedef struct IRNode_ IRNode;
 
@@ -139,6 +180,8 @@ void IRList_init();
 int IRList_length();
 void IRList_add(IR *ir);
 void IRList_remove(IRNode *irNode);
+IRNode *IRList_insert_before(IRNode *pos, IR *ir);
+IRNode *IRList_insert_after(IRNode *pos, IR *ir);
 void IRList_print();
 void IRList_print_2();
 
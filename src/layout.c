@@ -0,0 +1,343 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+
+// static branch prediction and block layout: the probability of each
+// conditional jump is estimated with the heuristics of Ball and Larus,
+// blocks are chained along their most frequent edges in the manner of
+// Pettis and Hansen, and loops are rotated so that the back edge is
+// the conditional jump at the bottom
+
+#define MAX_DEPTH 5
+#define LOOP_WEIGHT 8
+
+// probabilities that the heuristics give to the predicted successor
+#define PROB_LOOP_BRANCH 0.88
+#define PROB_LOOP_EXIT 0.80
+#define PROB_OPCODE 0.84
+#define PROB_RETURN 0.72
+
+typedef struct {
+    Block *from;
+    Block *to;
+    double weight;
+    bool enters_loop;
+} Edge;
+
+typedef struct {
+    CFG *cfg;
+    int nr_loop;
+    Loop *loops;
+    double *freq;
+    double *taken;   // probability of going to succ[1]
+    int *chain;      // the chain of each block, by its head
+    Block **next;    // the next block in the chain
+    Block **tail;    // the tail of each chain, by its head
+    Block *off_end;  // the block falling off the end of the function
+} Layout;
+
+static int nr_moved;
+
+static bool is_return_block(Block *b) {
+    return b->nr_succ == 0 && b->last->ir->kind == IR_RETURN;
+}
+
+// Dempster-Shafer combination of two predictions
+static double combine(double p, double q) {
+    return p * q / (p * q + (1 - p) * (1 - q));
+}
+
+// the probability that the conditional jump of b is taken
+static double predict(Layout *lo, Block *b) {
+    Block *fall = b->succ[0];
+    Block *target = b->succ[1];
+    IR *ir = b->last->ir;
+    double p = 0.5;
+
+    // loop branch: a back edge is taken, an exit is not
+    if (is_back_edge(b, target) && !is_back_edge(b, fall)) {
+        p = combine(p, PROB_LOOP_BRANCH);
+    } else if (is_back_edge(b, fall) && !is_back_edge(b, target)) {
+        p = combine(p, 1 - PROB_LOOP_BRANCH);
+    } else {
+        for (int l = 0; l < lo->nr_loop; l++) {
+            bool *in = lo->loops[l].body;
+            if (!in[b->id] || in[fall->id] == in[target->id]) {
+                continue;
+            }
+            p = combine(p, in[target->id]
+                    ? PROB_LOOP_EXIT : 1 - PROB_LOOP_EXIT);
+            break;
+        }
+    }
+
+    // opcode: values are rarely negative or equal to a constant
+    Operand *arg2 = ir->if_.arg2;
+    int relop = ir->if_.relop;
+    if (arg2->kind == INT_LITERAL && arg2->int_value == 0
+            && (relop == RELOP_LT || relop == RELOP_LE)) {
+        p = combine(p, 1 - PROB_OPCODE);
+    } else if (arg2->kind == INT_LITERAL && arg2->int_value == 0
+            && (relop == RELOP_GT || relop == RELOP_GE)) {
+        p = combine(p, PROB_OPCODE);
+    } else if (arg2->kind == INT_LITERAL && relop == RELOP_EQ) {
+        p = combine(p, 1 - PROB_OPCODE);
+    } else if (arg2->kind == INT_LITERAL && relop == RELOP_NE) {
+        p = combine(p, PROB_OPCODE);
+    }
+
+    // return: an early return is unlikely
+    if (is_return_block(target) && !is_return_block(fall)) {
+        p = combine(p, 1 - PROB_RETURN);
+    } else if (is_return_block(fall) && !is_return_block(target)) {
+        p = combine(p, PROB_RETURN);
+    }
+    return p;
+}
+
+static double edge_prob(Layout *lo, Block *b, int k) {
+    if (b->nr_succ == 1) {
+        return 1;
+    }
+    return k == 1 ? lo->taken[b->id] : 1 - lo->taken[b->id];
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const Edge *x = a, *y = b;
+    if (x->weight != y->weight) {
+        return x->weight < y->weight ? 1 : -1;
+    }
+    // keep the order of the list on ties
+    if (x->from->id != y->from->id) {
+        return x->from->id - y->from->id;
+    }
+    return x->to->id - y->to->id;
+}
+
+static bool can_chain(Layout *lo, Block *from, Block *to) {
+    return to->id != 0
+        && from != lo->off_end
+        && lo->next[from->id] == NULL
+        && lo->chain[to->id] == to->id
+        && lo->chain[from->id] != to->id;
+}
+
+static void chain(Layout *lo, Block *from, Block *to) {
+    int head = lo->chain[from->id];
+    lo->next[from->id] = to;
+    for (Block *b = to; b != NULL; b = lo->next[b->id]) {
+        lo->chain[b->id] = head;
+    }
+    lo->tail[head] = lo->tail[to->id];
+}
+
+// a loop whose header starts the chain and whose back edge ends it is
+// rotated, so that the header is tested at the bottom
+static void rotate_loops(Layout *lo) {
+    for (int l = 0; l < lo->nr_loop; l++) {
+        Block *h = lo->loops[l].header;
+        Block *t = lo->tail[h->id];
+        Block *second = lo->next[h->id];
+        if (h->id == 0 || lo->chain[h->id] != h->id || second == NULL
+                || !is_back_edge(t, h) || h->nr_succ != 2) {
+            continue;
+        }
+        info("rotate the loop at block %d", h->id);
+        for (Block *b = second; b != NULL; b = lo->next[b->id]) {
+            lo->chain[b->id] = second->id;
+        }
+        lo->next[h->id] = NULL;
+        lo->next[t->id] = h;
+        lo->chain[h->id] = second->id;
+        lo->tail[second->id] = h;
+        nr_moved++;
+    }
+}
+
+// the blocks in their new order
+static Block **layout(Layout *lo) {
+    CFG *cfg = lo->cfg;
+    int n = cfg->nr_block;
+    int nr_edge = 0;
+    Edge *edges = malloc((2 * n + 1) * sizeof(Edge));
+    for (int i = 0; i < n; i++) {
+        Block *b = cfg->blocks[i];
+        lo->chain[i] = i;
+        lo->next[i] = NULL;
+        lo->tail[i] = b;
+        for (int k = 0; k < b->nr_succ; k++) {
+            Block *s = b->succ[k];
+            edges[nr_edge].from = b;
+            edges[nr_edge].to = s;
+            edges[nr_edge].weight = lo->freq[i] * edge_prob(lo, b, k);
+            edges[nr_edge].enters_loop = false;
+            for (int l = 0; l < lo->nr_loop; l++) {
+                if (lo->loops[l].header == s && !lo->loops[l].body[i]) {
+                    edges[nr_edge].enters_loop = true;
+                }
+            }
+            nr_edge++;
+        }
+    }
+    qsort(edges, nr_edge, sizeof(Edge), compare_edges);
+
+    // edges into loops are chained after the loops are rotated
+    for (int i = 0; i < nr_edge; i++) {
+        Edge *e = &edges[i];
+        if (!e->enters_loop && can_chain(lo, e->from, e->to)) {
+            chain(lo, e->from, e->to);
+        }
+    }
+    rotate_loops(lo);
+    for (int i = 0; i < nr_edge; i++) {
+        Edge *e = &edges[i];
+        if (e->enters_loop && can_chain(lo, e->from, e->to)) {
+            chain(lo, e->from, e->to);
+        }
+    }
+
+    // the entry chain first; a chain is followed by the chain that
+    // starts at the likely successor of its tail if there is one, or
+    // else by the first chain left in list order; a block that falls
+    // off the end of the function stays last
+    Block **order = malloc((n + 1) * sizeof(Block *));
+    bool *placed = malloc(n * sizeof(bool));
+    for (int i = 0; i < n; i++) {
+        placed[i] = false;
+    }
+    int last_chain = -1;
+    if (lo->off_end != NULL) {
+        Block *end = lo->off_end;
+        if (lo->chain[end->id] == 0) {
+            // the entry chain must come first, the block is split off
+            // the end of it and its predecessor jumps to it
+            Block *prev = cfg->blocks[0];
+            while (lo->next[prev->id] != end) {
+                prev = lo->next[prev->id];
+            }
+            lo->next[prev->id] = NULL;
+            lo->tail[0] = prev;
+            lo->chain[end->id] = end->id;
+            lo->tail[end->id] = end;
+        }
+        last_chain = lo->chain[end->id];
+        placed[last_chain] = true;
+    }
+    int m = 0;
+    int head = -1;
+    while (true) {
+        for (int i = 0; i < n && head < 0; i++) {
+            if (lo->chain[i] == i && !placed[i]) {
+                head = i;
+            }
+        }
+        if (head < 0) {
+            break;
+        }
+        placed[head] = true;
+        for (Block *b = cfg->blocks[head]; b != NULL; b = lo->next[b->id]) {
+            order[m++] = b;
+        }
+        Block *tail = order[m - 1];
+        head = -1;
+        double best = -1;
+        for (int k = 0; k < tail->nr_succ; k++) {
+            int s = tail->succ[k]->id;
+            if (lo->chain[s] == s && !placed[s]
+                    && edge_prob(lo, tail, k) > best) {
+                head = s;
+                best = edge_prob(lo, tail, k);
+            }
+        }
+    }
+    if (last_chain >= 0) {
+        for (Block *b = cfg->blocks[last_chain]; b != NULL;
+                b = lo->next[b->id]) {
+            order[m++] = b;
+        }
+    }
+    return order;
+}
+
+// relink the blocks in order, fixing the jumps at their ends
+static void emit(CFG *cfg, Block **order, Block *off_end) {
+    int n = cfg->nr_block;
+    for (int i = 1; i < n; i++) {
+        block_label(cfg->blocks[i]);
+    }
+    int nr_ir = 0;
+    IR **irs = malloc((IRList_length() + n + 1) * sizeof(IR *));
+    for (int i = 0; i < n; i++) {
+        Block *b = order[i];
+        Block *next = (i + 1 < n) ? order[i + 1] : NULL;
+        for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+            irs[nr_ir++] = q->ir;
+        }
+        IR *ir = b->last->ir;
+        if (ir->kind == IR_GOTO || ir->kind == IR_RETURN
+                || b->nr_succ == 0 || b == off_end) {
+            continue;
+        }
+        Block *fall = b->succ[0];
+        if (ir->kind == IR_IF && b->nr_succ == 2 && fall != next
+                && b->succ[1] == next) {
+            irs[nr_ir - 1] = newIf(ir->if_.arg1, invert_relop(ir->if_.relop),
+                    ir->if_.arg2, block_label(fall));
+        } else if (fall != next) {
+            irs[nr_ir++] = newGoto(block_label(fall));
+        }
+    }
+    IRNode *q = cfg->func->next;
+    while (q != cfg->end) {
+        IRNode *next = q->next;
+        IRList_remove(q);
+        q = next;
+    }
+    q = cfg->func;
+    for (int i = 0; i < nr_ir; i++) {
+        q = IRList_insert_after(q, irs[i]);
+    }
+}
+
+static void layout_function(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    int n = cfg->nr_block;
+    if (n < 3) {
+        return;
+    }
+    compute_dominators(cfg);
+    Layout *lo = malloc(sizeof(Layout));
+    lo->cfg = cfg;
+    lo->nr_loop = find_loops(cfg, &lo->loops);
+    lo->freq = malloc(n * sizeof(double));
+    lo->taken = malloc(n * sizeof(double));
+    lo->chain = malloc(n * sizeof(int));
+    lo->next = malloc(n * sizeof(Block *));
+    lo->tail = malloc(n * sizeof(Block *));
+    IR *last = cfg->blocks[n - 1]->last->ir;
+    lo->off_end = (last->kind == IR_GOTO || last->kind == IR_RETURN)
+        ? NULL : cfg->blocks[n - 1];
+    if (lo->off_end == cfg->blocks[0]) {
+        // nothing after the entry is reached
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        Block *b = cfg->blocks[i];
+        int depth = b->loop_depth < MAX_DEPTH ? b->loop_depth : MAX_DEPTH;
+        lo->freq[i] = 1;
+        for (int d = 0; d < depth; d++) {
+            lo->freq[i] *= LOOP_WEIGHT;
+        }
+        lo->taken[i] = (b->nr_succ == 2) ? predict(lo, b) : 0;
+    }
+    emit(cfg, layout(lo), lo->off_end);
+}
+
+void layout_blocks() {
+    info("laying out blocks...");
+    nr_moved = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        layout_function(f);
+    }
+    info("%d loops rotated", nr_moved);
+}
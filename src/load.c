@@ -0,0 +1,180 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "alias.h"
+#include "vn.h"
+#include "modref.h"
+
+// redundant load elimination over extended basic blocks: values are
+// numbered locally, and a `*p' whose value a temp or variable still
+// holds, from an earlier load or store at the same address, is
+// replaced with that temp or variable
+
+// *addr == value, while value still has value_vn
+typedef struct {
+    Operand *addr;
+    int addr_vn;
+    Operand *value;
+    int value_vn;
+} Avail;
+
+typedef struct {
+    VNState *vn;
+    int nr_avail;
+    Avail *avail;
+} State;
+
+static int nr_eliminated;
+
+static State *newState() {
+    State *s = malloc(sizeof(State));
+    s->vn = newVNState();
+    s->nr_avail = 0;
+    s->avail = NULL;
+    return s;
+}
+
+static State *copy_state(State *s) {
+    State *c = malloc(sizeof(State));
+    c->vn = copy_vn_state(s->vn);
+    c->nr_avail = s->nr_avail;
+    c->avail = malloc(s->nr_avail * sizeof(Avail) + 1);
+    memcpy(c->avail, s->avail, s->nr_avail * sizeof(Avail));
+    return c;
+}
+
+static void add_avail(State *s, Operand *addr, int addr_vn,
+        Operand *value, int value_vn) {
+    s->avail = realloc(s->avail, (s->nr_avail + 1) * sizeof(Avail));
+    s->avail[s->nr_avail].addr = addr;
+    s->avail[s->nr_avail].addr_vn = addr_vn;
+    s->avail[s->nr_avail].value = value;
+    s->avail[s->nr_avail].value_vn = value_vn;
+    s->nr_avail++;
+}
+
+static void kill_avail(State *s, int i) {
+    s->avail[i] = s->avail[--s->nr_avail];
+}
+
+static Avail *find_avail(State *s, Operand *addr) {
+    int addr_vn = vn_of(s->vn, addr);
+    for (int i = 0; i < s->nr_avail; i++) {
+        Avail *a = &s->avail[i];
+        if (vn_of(s->vn, a->value) != a->value_vn) {
+            continue;
+        }
+        if (a->addr_vn == addr_vn || must_alias(a->addr, addr)) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
+static bool is_value(Operand *op) {
+    return op->kind == TEMP
+        || op->kind == VAR_OPERAND
+        || op->kind == INT_LITERAL;
+}
+
+static void replace_loads(State *s, IR *ir) {
+    Operand **slots[MAX_READ_SLOT];
+    int n = ir_read_slots(ir, slots);
+    for (int i = 0; i < n; i++) {
+        Operand *op = *slots[i];
+        if (op->kind != INDIR) {
+            continue;
+        }
+        Avail *a = find_avail(s, op->indir_var);
+        if (a != NULL) {
+            info("load %s is available in %s",
+                    op_repr(op), op_repr(a->value));
+            *slots[i] = a->value;
+            nr_eliminated++;
+        }
+    }
+}
+
+static void process_ir(State *s, IR *ir) {
+    replace_loads(s, ir);
+
+    int addr_vn = 0;
+    if (ir->kind == IR_ASSIGN && ir->arg1->kind == INDIR) {
+        addr_vn = vn_of(s->vn, ir->arg1->indir_var);
+    }
+    int vn = vn_update(s->vn, ir);
+    if (addr_vn != 0 && vn != 0) {
+        add_avail(s, ir->arg1->indir_var, addr_vn, ir->result, vn);
+    }
+
+    Operand *store = ir_store(ir);
+    if (store != NULL) {
+        Operand *addr = store->indir_var;
+        int addr_vn = vn_of(s->vn, addr);
+        for (int i = s->nr_avail - 1; i >= 0; i--) {
+            Avail *a = &s->avail[i];
+            if (a->addr_vn == addr_vn || may_alias(a->addr, addr)) {
+                kill_avail(s, i);
+            }
+        }
+        if (is_value(ir->arg1)) {
+            add_avail(s, addr, addr_vn, ir->arg1, vn_of(s->vn, ir->arg1));
+        }
+    }
+
+    if (ir->kind == IR_CALL && call_writes_memory(ir)) {
+        for (int i = s->nr_avail - 1; i >= 0; i--) {
+            if (call_may_access(s->avail[i].addr)) {
+                kill_avail(s, i);
+            }
+        }
+    }
+}
+
+static void process_block(CFG *cfg, Block *b, State *s, bool *visited) {
+    visited[b->id] = true;
+    for (IRNode *q = b->first; ; q = q->next) {
+        process_ir(s, q->ir);
+        if (q == b->last) {
+            break;
+        }
+    }
+    for (int i = 0; i < b->nr_succ; i++) {
+        Block *succ = b->succ[i];
+        if (succ->nr_pred == 1 && succ != cfg->blocks[0]
+                && !visited[succ->id]) {
+            process_block(cfg, succ, copy_state(s), visited);
+        }
+    }
+}
+
+static void eliminate_function_loads(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    bool *visited = malloc((cfg->nr_block + 1) * sizeof(bool));
+    for (int i = 0; i < cfg->nr_block; i++) {
+        visited[i] = false;
+    }
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        if (!visited[i] && (i == 0 || b->nr_pred != 1)) {
+            process_block(cfg, b, newState(), visited);
+        }
+    }
+    // blocks on a cycle of single-predecessor blocks
+    for (int i = 0; i < cfg->nr_block; i++) {
+        if (!visited[i]) {
+            process_block(cfg, cfg->blocks[i], newState(), visited);
+        }
+    }
+}
+
+void eliminate_redundant_loads() {
+    info("eliminating redundant loads...");
+    alias_analyze();
+    vn_init();
+    nr_eliminated = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        eliminate_function_loads(f);
+    }
+    info("%d loads eliminated", nr_eliminated);
+}
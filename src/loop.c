@@ -0,0 +1,433 @@
+#include "common.h"
+#include "ir.h"
+#include "dep.h"
+#include "alias.h"
+
+extern IRList irList;
+
+// a while loop as translate_Stmt lowers it:
+//
+//     iv := #k
+//   LABEL Lh :
+//     IF iv relop bound GOTO Lb
+//     GOTO Le
+//   LABEL Lb :
+//     ...
+//     iv := iv + #c
+//     GOTO Lh
+//   LABEL Le :
+typedef struct {
+    IRNode *init;
+    IRNode *header;
+    IRNode *cond;
+    IRNode *body;
+    IRNode *step;
+    IRNode *latch;
+    IRNode *exit;
+    Operand *iv;
+} WhileLoop;
+
+static bool is_label(IRNode *q, int label_no) {
+    return q != NULL
+        && q->ir->kind == IR_LABEL
+        && q->ir->label.label_no == label_no;
+}
+
+static bool is_goto(IRNode *q, int label_no) {
+    return q != NULL
+        && q->ir->kind == IR_GOTO
+        && label_number(q->ir->goto_.label) == label_no;
+}
+
+static bool is_scalar(Operand *op) {
+    return op->kind == TEMP || op->kind == VAR_OPERAND;
+}
+
+static bool ir_reads(IR *ir, Operand *op) {
+    if (ir_contains(ir, op)) {
+        return true;
+    }
+    return ir->kind == IR_ASSIGN
+        && ir->result->kind == INDIR
+        && op_contains(ir->result->indir_var, op);
+}
+
+// the last definition of iv in the straight-line code before header
+static IRNode *find_init(IRNode *header, Operand *iv) {
+    for (IRNode *q = header->prev; q != NULL; q = q->prev) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_LABEL || ir->kind == IR_FUNCTION
+                || ir->kind == IR_GOTO || ir->kind == IR_IF
+                || ir->kind == IR_RETURN || ir->kind == IR_CALL) {
+            return NULL;
+        }
+        Operand *def = ir_def(ir);
+        if (def != NULL && op_equals(def, iv)) {
+            if (ir->kind == IR_ASSIGN && ir->arg1->kind == INT_LITERAL) {
+                return q;
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static bool match_while(IRNode *header, WhileLoop *loop) {
+    if (header == NULL || header->ir->kind != IR_LABEL) {
+        return false;
+    }
+    IRNode *cond = header->next;
+    if (cond == NULL || cond->ir->kind != IR_IF
+            || cond->ir->if_.arg1->kind != VAR_OPERAND
+            || !(is_scalar(cond->ir->if_.arg2)
+                || cond->ir->if_.arg2->kind == INT_LITERAL)) {
+        return false;
+    }
+    IRNode *exit_goto = cond->next;
+    if (exit_goto == NULL || exit_goto->ir->kind != IR_GOTO) {
+        return false;
+    }
+    IRNode *body = exit_goto->next;
+    if (!is_label(body, label_number(cond->ir->if_.label))) {
+        return false;
+    }
+    int exit_no = label_number(exit_goto->ir->goto_.label);
+    IRNode *exit = body->next;
+    while (exit != NULL && exit->ir->kind != IR_FUNCTION
+            && !is_label(exit, exit_no)) {
+        exit = exit->next;
+    }
+    if (!is_label(exit, exit_no)
+            || !is_goto(exit->prev, header->ir->label.label_no)) {
+        return false;
+    }
+    IRNode *latch = exit->prev;
+    IRNode *step = latch->prev;
+    Operand *iv = cond->ir->if_.arg1;
+    if (step == body
+            || step->ir->kind != IR_ADD
+            || !op_equals(step->ir->result, iv)
+            || !op_equals(step->ir->arg1, iv)
+            || step->ir->arg2->kind != INT_LITERAL) {
+        return false;
+    }
+    IRNode *init = find_init(header, iv);
+    if (init == NULL) {
+        return false;
+    }
+    loop->init = init;
+    loop->header = header;
+    loop->cond = cond;
+    loop->body = body;
+    loop->step = step;
+    loop->latch = latch;
+    loop->exit = exit;
+    loop->iv = iv;
+    return true;
+}
+
+static bool range_defines_label(IRNode *from, IRNode *to, Label *label) {
+    for (IRNode *q = from; q != to; q = q->next) {
+        if (is_label(q, label_number(label))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the body must be a single-entry region without calls, I/O
+// and jumps leaving it; the step is the only definition of iv
+static bool is_fusible_body(WhileLoop *loop) {
+    IRNode *first = loop->body->next;
+    for (IRNode *q = first; q != loop->step; q = q->next) {
+        IR *ir = q->ir;
+        if (ir->kind == IR_FUNCTION
+                || ir->kind == IR_RETURN
+                || ir->kind == IR_ARG
+                || ir->kind == IR_CALL
+                || ir->kind == IR_PARAM
+                || ir->kind == IR_READ
+                || ir->kind == IR_WRITE
+                || ir->kind == IR_ALLOC) {
+            return false;
+        }
+        if (ir->kind == IR_GOTO
+                && !range_defines_label(first, loop->step, ir->goto_.label)) {
+            return false;
+        }
+        if (ir->kind == IR_IF
+                && !range_defines_label(first, loop->step, ir->if_.label)) {
+            return false;
+        }
+        Operand *def = ir_def(ir);
+        if (def != NULL
+                && (op_equals(def, loop->iv)
+                    || op_equals(def, loop->cond->ir->if_.arg2))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    ArrayRef *ref;  // NULL if the subscript is unknown
+    bool is_store;
+} Access;
+
+#define MAX_ACCESS 64
+
+static int collect_accesses(WhileLoop *loop, Access *acc) {
+    int n = 0;
+    for (IRNode *q = loop->body->next; q != loop->step; q = q->next) {
+        IR *ir = q->ir;
+        Operand *ops[MAX_READ_SLOT + 1] = { ir_store(ir) };
+        Operand **slots[MAX_READ_SLOT];
+        int nr_op = ir_read_slots(ir, slots) + 1;
+        for (int i = 1; i < nr_op; i++) {
+            ops[i] = *slots[i - 1];
+        }
+        for (int i = 0; i < nr_op; i++) {
+            if (ops[i] == NULL || ops[i]->kind != INDIR) {
+                continue;
+            }
+            if (n == MAX_ACCESS) {
+                return -1;
+            }
+            acc[n].ref = ops[i]->array_ref;
+            acc[n].is_store = (i == 0);
+            n++;
+        }
+    }
+    return n;
+}
+
+static void loop_level(WhileLoop *loop, LoopLevel *level) {
+    IR *cond = loop->cond->ir;
+    int init = loop->init->ir->arg1->int_value;
+    int step = loop->step->ir->arg2->int_value;
+    level->iv = loop->iv;
+    level->step = step;
+    level->has_bounds = false;
+    if (cond->if_.arg2->kind != INT_LITERAL) {
+        return;
+    }
+    int bound = cond->if_.arg2->int_value;
+    int relop = cond->if_.relop;
+    if (step > 0 && (relop == RELOP_LT || relop == RELOP_LE)) {
+        level->has_bounds = true;
+        level->lower = init;
+        level->upper = relop == RELOP_LT ? bound - 1 : bound;
+    } else if (step < 0 && (relop == RELOP_GT || relop == RELOP_GE)) {
+        level->has_bounds = true;
+        level->lower = relop == RELOP_GT ? bound + 1 : bound;
+        level->upper = init;
+    }
+}
+
+// fusing runs iteration u of the first body right before iteration u
+// of the second one, so no dependence may go from a later iteration
+// of the first loop to an earlier one of the second
+static bool can_fuse_accesses(WhileLoop *l1, WhileLoop *l2) {
+    Access acc1[MAX_ACCESS], acc2[MAX_ACCESS];
+    int n1 = collect_accesses(l1, acc1);
+    int n2 = collect_accesses(l2, acc2);
+    if (n1 < 0 || n2 < 0) {
+        return false;
+    }
+    LoopLevel level;
+    loop_level(l1, &level);
+    for (int i = 0; i < n1; i++) {
+        for (int j = 0; j < n2; j++) {
+            Access *a = &acc1[i];
+            Access *b = &acc2[j];
+            if (!a->is_store && !b->is_store) {
+                continue;
+            }
+            if (a->ref == NULL || b->ref == NULL) {
+                return false;
+            }
+            if (!op_equals(a->ref->base, b->ref->base)) {
+                if (!may_alias(a->ref->base, b->ref->base)) {
+                    continue;
+                }
+                return false;
+            }
+            Dependence dep;
+            test_dependence(a->ref, l1->body->next, l1->step,
+                    b->ref, l2->body->next, l2->step,
+                    &level, 1, &dep);
+            info("dependence %s[] -> %s[]: %s",
+                    op_repr(a->ref->base), op_repr(b->ref->base),
+                    dep_repr(&dep));
+            if (dep.kind == DEP_EXISTS && (dep.direction[0] & DIR_GT)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool range_reads(IRNode *from, IRNode *to, Operand *op) {
+    for (IRNode *q = from; q != to; q = q->next) {
+        if (ir_reads(q->ir, op)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool range_defines(IRNode *from, IRNode *to, Operand *op) {
+    for (IRNode *q = from; q != to; q = q->next) {
+        Operand *def = ir_def(q->ir);
+        if (def != NULL && op_equals(def, op)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// scalars written by one body must be private to it
+static bool can_fuse_scalars(WhileLoop *l1, WhileLoop *l2) {
+    IRNode *b1 = l1->body->next;
+    IRNode *b2 = l2->body->next;
+    for (IRNode *q = b1; q != l1->step; q = q->next) {
+        Operand *def = ir_def(q->ir);
+        if (def != NULL && (range_reads(b2, l2->step, def)
+                    || range_defines(b2, l2->step, def))) {
+            return false;
+        }
+    }
+    for (IRNode *q = b2; q != l2->step; q = q->next) {
+        Operand *def = ir_def(q->ir);
+        if (def != NULL && range_reads(b1, l1->step, def)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the code between the loops is re-initialization of iv plus
+// scalar assignments independent of the first loop, which can be
+// hoisted above it
+static bool can_hoist_between(WhileLoop *l1, WhileLoop *l2) {
+    IRNode *b1 = l1->body->next;
+    for (IRNode *q = l1->exit->next; q != l2->header; q = q->next) {
+        if (q == l2->init) {
+            continue;
+        }
+        IR *ir = q->ir;
+        if (ir->kind != IR_ASSIGN && ir->kind != IR_ADD
+                && ir->kind != IR_SUB && ir->kind != IR_MUL) {
+            return false;
+        }
+        Operand *def = ir_def(ir);
+        if (def == NULL
+                || ir->arg1->kind == INDIR
+                || (ir->kind != IR_ASSIGN && ir->arg2->kind == INDIR)) {
+            return false;
+        }
+        if (op_equals(def, l1->iv)
+                || op_equals(def, l1->cond->ir->if_.arg2)
+                || range_reads(b1, l1->latch, def)
+                || range_defines(b1, l1->latch, def)) {
+            return false;
+        }
+        for (IRNode *p = b1; p != l1->latch; p = p->next) {
+            Operand *d = ir_def(p->ir);
+            if (d != NULL && ir_reads(ir, d)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool is_conformable(WhileLoop *l1, WhileLoop *l2) {
+    IR *c1 = l1->cond->ir;
+    IR *c2 = l2->cond->ir;
+    return op_equals(l1->iv, l2->iv)
+        && c1->if_.relop == c2->if_.relop
+        && op_equals(c1->if_.arg2, c2->if_.arg2)
+        && op_equals(l1->init->ir->arg1, l2->init->ir->arg1)
+        && op_equals(l1->step->ir->arg2, l2->step->ir->arg2);
+}
+
+static bool label_referenced(int label_no) {
+    for (IRNode *q = irList.head; q != NULL; q = q->next) {
+        if (q->ir->kind == IR_GOTO
+                && label_number(q->ir->goto_.label) == label_no) {
+            return true;
+        }
+        if (q->ir->kind == IR_IF
+                && label_number(q->ir->if_.label) == label_no) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void remove_range(IRNode *from, IRNode *to) {
+    IRNode *q = from;
+    while (q != to) {
+        IRNode *next = q->next;
+        IRList_remove(q);
+        q = next;
+    }
+}
+
+static void fuse(WhileLoop *l1, WhileLoop *l2) {
+    info("fuse loops at L%d and L%d",
+            l1->header->ir->label.label_no,
+            l2->header->ir->label.label_no);
+    // hoist the independent code between the loops
+    IRNode *q = l1->exit->next;
+    while (q != l2->header) {
+        IRNode *next = q->next;
+        IRList_remove(q);
+        if (q != l2->init) {
+            IRList_insert_before(l1->header, q->ir);
+        }
+        q = next;
+    }
+    // move the second body in front of the first step
+    q = l2->body->next;
+    while (q != l2->step) {
+        IRNode *next = q->next;
+        IRList_remove(q);
+        IRList_insert_before(l1->step, q->ir);
+        q = next;
+    }
+    IRNode *exit2 = l2->exit;
+    remove_range(l2->header, exit2);
+    if (!label_referenced(exit2->ir->label.label_no)) {
+        IRList_remove(exit2);
+    }
+}
+
+void fuse_loops() {
+    info("fusing loops...");
+    alias_analyze();
+    IRNode *q = irList.head;
+    while (q != NULL) {
+        WhileLoop l1, l2;
+        if (match_while(q, &l1)) {
+            // the second header follows the code between the loops
+            IRNode *h = l1.exit->next;
+            while (h != NULL && h->ir->kind != IR_LABEL
+                    && h->ir->kind != IR_FUNCTION) {
+                h = h->next;
+            }
+            if (match_while(h, &l2)
+                    && is_conformable(&l1, &l2)
+                    && is_fusible_body(&l1)
+                    && is_fusible_body(&l2)
+                    && can_hoist_between(&l1, &l2)
+                    && can_fuse_scalars(&l1, &l2)
+                    && can_fuse_accesses(&l1, &l2)) {
+                fuse(&l1, &l2);
+                continue;
+            }
+        }
+        q = q->next;
+    }
+}
@@ -0,0 +1,224 @@
+#include "common.h"
+#include "ir.h"
+#include "callgraph.h"
+
+// identical function merging: each function is written out with its
+// temps, labels and own variables numbered in order of appearance, and
+// functions with the same text are merged into the first of them; the
+// calls to the others are retargeted and their bodies removed
+//
+// the merged function keeps its variables, which live in static storage:
+// functions that are not recursive cannot be active while one another is
+// called, as they call the same functions; merging may make callers
+// identical too, so this is repeated
+
+#define NR_BUCKET 97
+
+typedef struct Body_ Body;
+
+struct Body_ {
+    Function *func;
+    char *text;
+    unsigned hash;
+    Body *next;  // in the same bucket
+};
+
+static int *temp_map;  // by number, 0 if not seen yet
+static int nr_canon_temp;
+static int nr_canon_label;
+static int *label_from;
+static int nr_canon_var;
+static char **var_from;
+static int nr_merged;
+
+static Operand *canon_temp(Operand *op) {
+    if (temp_map[op->temp_no] == 0) {
+        temp_map[op->temp_no] = ++nr_canon_temp;
+    }
+    // not made by newTemp(), it only stands for the temp in the text
+    Operand *temp = malloc(sizeof(Operand));
+    temp->kind = TEMP;
+    temp->temp_no = temp_map[op->temp_no];
+    temp->array_ref = NULL;
+    return temp;
+}
+
+// the globals keep their names, which cannot clash with `%v1'
+static Operand *canon_var(Operand *op) {
+    if (is_global(op->var_name)) {
+        return op;
+    }
+    int i = 0;
+    while (i < nr_canon_var && strcmp(var_from[i], op->var_name) != 0) {
+        i++;
+    }
+    if (i == nr_canon_var) {
+        var_from = realloc(var_from, (nr_canon_var + 1) * sizeof(char *));
+        var_from[nr_canon_var++] = op->var_name;
+    }
+    char *name = malloc(20);
+    sprintf(name, "%%v%d", i + 1);
+    return newVariableOperand(name);
+}
+
+static Operand *canon_op(Operand *op) {
+    if (op == NULL) {
+        return NULL;
+    } else if (op->kind == TEMP) {
+        return canon_temp(op);
+    } else if (op->kind == VAR_OPERAND) {
+        return canon_var(op);
+    } else if (op->kind == ADDR) {
+        return newAddr(canon_op(op->addr_var));
+    } else if (op->kind == INDIR) {
+        return newIndir(canon_op(op->indir_var));
+    } else {
+        return op;
+    }
+}
+
+static int canon_label(int label_no) {
+    int i = 0;
+    while (i < nr_canon_label && label_from[i] != label_no) {
+        i++;
+    }
+    if (i == nr_canon_label) {
+        label_from = realloc(label_from, (nr_canon_label + 1) * sizeof(int));
+        label_from[nr_canon_label++] = label_no;
+    }
+    return i + 1;
+}
+
+static IR *canon_ir(IR *ir) {
+    IR *copy = copy_ir(ir);
+    Operand **slots[MAX_READ_SLOT];
+    int n = ir_read_slots(copy, slots);
+    for (int i = 0; i < n; i++) {
+        *slots[i] = canon_op(*slots[i]);
+    }
+    if (copy->kind == IR_ASSIGN
+            || copy->kind == IR_ADD
+            || copy->kind == IR_SUB
+            || copy->kind == IR_MUL
+            || copy->kind == IR_DIV
+            || copy->kind == IR_CALL
+            || copy->kind == IR_CMP
+            || copy->kind == IR_SELECT
+            || copy->kind == IR_SHL
+            || copy->kind == IR_SHR
+            || copy->kind == IR_SHRU
+            || copy->kind == IR_MULH) {
+        copy->result = canon_op(copy->result);
+    } else if (copy->kind == IR_READ || copy->kind == IR_PARAM) {
+        copy->arg1 = canon_op(copy->arg1);
+    } else if (copy->kind == IR_ALLOC) {
+        copy->alloc.var = canon_op(copy->alloc.var);
+    } else if (copy->kind == IR_LABEL) {
+        copy->label.label_no = canon_label(copy->label.label_no);
+    } else if (copy->kind == IR_GOTO) {
+        copy->goto_.label =
+            label_of(canon_label(label_number(copy->goto_.label)));
+    } else if (copy->kind == IR_IF) {
+        copy->if_.label = label_of(canon_label(label_number(copy->if_.label)));
+    }
+    return copy;
+}
+
+static char *canon_text(Function *f) {
+    extern int nr_temp;
+    for (int i = 0; i <= nr_temp; i++) {
+        temp_map[i] = 0;
+    }
+    nr_canon_temp = 0;
+    nr_canon_label = 0;
+    nr_canon_var = 0;
+    int size = 1;
+    char *text = malloc(size);
+    text[0] = '\0';
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        char *line = ir_repr(canon_ir(q->ir));
+        size += strlen(line) + 1;
+        text = realloc(text, size);
+        strcat(text, line);
+        strcat(text, "\n");
+    }
+    return text;
+}
+
+static unsigned hash_of(char *text) {
+    unsigned h = 5381;
+    for (char *p = text; *p != '\0'; p++) {
+        h = h * 33 + (unsigned char) *p;
+    }
+    return h;
+}
+
+static void merge(CallGraph *cg, Function *g, Function *into) {
+    info("merge %s into %s", g->name, into->name);
+    for (int k = 0; k < g->nr_caller; k++) {
+        Function *f = g->callers[k];
+        for (int j = 0; j < f->nr_call; j++) {
+            IRNode *call = f->calls[j];
+            if (callee_of(cg, call->ir) == g) {
+                call->ir = newCall(call->ir->result, into->name);
+            }
+        }
+    }
+    IRNode *q = g->node;
+    while (q != g->end) {
+        IRNode *next = q->next;
+        IRList_remove(q);
+        q = next;
+    }
+    nr_merged++;
+}
+
+static int merge_round() {
+    extern int nr_temp;
+    temp_map = malloc((nr_temp + 1) * sizeof(int));
+    CallGraph *cg = newCallGraph();
+    Body *buckets[NR_BUCKET];
+    for (int i = 0; i < NR_BUCKET; i++) {
+        buckets[i] = NULL;
+    }
+    // the texts are all made before any function is removed
+    int nr_body = 0;
+    Body *bodies = malloc((cg->nr_func + 1) * sizeof(Body));
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *f = cg->funcs[i];
+        if (f == cg->main || !f->reachable || f->recursive) {
+            continue;
+        }
+        Body *b = &bodies[nr_body++];
+        b->func = f;
+        b->text = canon_text(f);
+        b->hash = hash_of(b->text);
+        b->next = NULL;
+    }
+    int n = 0;
+    for (int i = 0; i < nr_body; i++) {
+        Body *b = &bodies[i];
+        Body **p = &buckets[b->hash % NR_BUCKET];
+        while (*p != NULL && ((*p)->hash != b->hash
+                    || strcmp((*p)->text, b->text) != 0)) {
+            p = &(*p)->next;
+        }
+        if (*p == NULL) {
+            *p = b;
+        } else {
+            merge(cg, b->func, (*p)->func);
+            n++;
+        }
+    }
+    return n;
+}
+
+void merge_functions() {
+    info("merging identical functions...");
+    nr_merged = 0;
+    int n;
+    do {
+        n = merge_round();
+    } while (n > 0);
+    info("%d functions merged", nr_merged);
+}
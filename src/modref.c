@@ -0,0 +1,206 @@
+#include "common.h"
+#include "ir.h"
+#include "callgraph.h"
+#include "modref.h"
+
+// interprocedural mod/ref: the variables a function may assign or read,
+// with its own, and whether it accesses memory through `*p' or does
+// I/O, all including the functions it calls; computed bottom-up over
+// the call graph, a cycle of calls sharing one summary
+//
+// a pure function only reads its parameters: calling it again with the
+// same arguments gives the same result, and a call whose result is not
+// used can be removed
+
+typedef struct {
+    char *name;
+    int nr_mod;
+    char **mod;
+    int nr_ref;
+    char **ref;
+    bool reads_memory;
+    bool writes_memory;
+    bool io;
+    bool pure;
+} Summary;
+
+static int nr_summary;
+static Summary **summaries;
+
+static void add_name(char ***names, int *n, char *name) {
+    for (int i = 0; i < *n; i++) {
+        if (strcmp((*names)[i], name) == 0) {
+            return;
+        }
+    }
+    *names = realloc(*names, (*n + 1) * sizeof(char *));
+    (*names)[(*n)++] = name;
+}
+
+static bool has_name(char **names, int n, char *name) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool has_global(char **names, int n) {
+    for (int i = 0; i < n; i++) {
+        if (is_global(names[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Summary *newSummary(char *name) {
+    Summary *s = malloc(sizeof(Summary));
+    s->name = name;
+    s->nr_mod = 0;
+    s->mod = NULL;
+    s->nr_ref = 0;
+    s->ref = NULL;
+    s->reads_memory = false;
+    s->writes_memory = false;
+    s->io = false;
+    s->pure = false;
+    return s;
+}
+
+// the variables read in op; the address of an array is not a read
+static void add_reads(Summary *s, Operand *op) {
+    if (op->kind == VAR_OPERAND) {
+        add_name(&s->ref, &s->nr_ref, op->var_name);
+    } else if (op->kind == INDIR) {
+        s->reads_memory = true;
+        add_reads(s, op->indir_var);
+    }
+}
+
+static void add_function(Summary *s, Function *f) {
+    for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+        IR *ir = q->ir;
+        Operand **slots[MAX_READ_SLOT];
+        int n = ir_read_slots(ir, slots);
+        for (int i = 0; i < n; i++) {
+            add_reads(s, *slots[i]);
+        }
+        Operand *def = ir_def(ir);
+        if (def != NULL && def->kind == VAR_OPERAND) {
+            add_name(&s->mod, &s->nr_mod, def->var_name);
+        }
+        Operand *dest = NULL;
+        if (ir->kind == IR_ASSIGN || ir->kind == IR_CALL) {
+            dest = ir->result;
+        } else if (ir->kind == IR_READ) {
+            dest = ir->arg1;
+        }
+        if (dest != NULL && dest->kind == INDIR) {
+            s->writes_memory = true;
+            add_reads(s, dest->indir_var);
+        }
+        if (ir->kind == IR_READ || ir->kind == IR_WRITE) {
+            s->io = true;
+        }
+    }
+}
+
+static void add_summary(Summary *s, Summary *t) {
+    for (int i = 0; i < t->nr_mod; i++) {
+        add_name(&s->mod, &s->nr_mod, t->mod[i]);
+    }
+    for (int i = 0; i < t->nr_ref; i++) {
+        add_name(&s->ref, &s->nr_ref, t->ref[i]);
+    }
+    s->reads_memory = s->reads_memory || t->reads_memory;
+    s->writes_memory = s->writes_memory || t->writes_memory;
+    s->io = s->io || t->io;
+}
+
+static Summary *summary_of(IR *call) {
+    for (int i = 0; i < nr_summary; i++) {
+        if (strcmp(summaries[i]->name, call->arg1->sym_name) == 0) {
+            return summaries[i];
+        }
+    }
+    return NULL;
+}
+
+void compute_summaries() {
+    info("computing mod/ref summaries...");
+    CallGraph *cg = newCallGraph();
+    nr_summary = 0;
+    summaries = malloc((cg->nr_func + 1) * sizeof(Summary *));
+    int *by_id = malloc((cg->nr_func + 1) * sizeof(int));
+    // the components come in order, callees first
+    for (int first = 0, last; first < cg->nr_func; first = last) {
+        int scc = cg->bottom_up[first]->scc;
+        last = first;
+        while (last < cg->nr_func && cg->bottom_up[last]->scc == scc) {
+            last++;
+        }
+        Summary *s = newSummary(NULL);
+        for (int i = first; i < last; i++) {
+            Function *f = cg->bottom_up[i];
+            add_function(s, f);
+            for (int k = 0; k < f->nr_callee; k++) {
+                Function *g = f->callees[k];
+                if (g->scc != scc) {
+                    add_summary(s, summaries[by_id[g->id]]);
+                }
+            }
+        }
+        s->pure = !s->io && !s->reads_memory && !s->writes_memory
+            && !has_global(s->mod, s->nr_mod)
+            && !has_global(s->ref, s->nr_ref)
+            && !cg->bottom_up[first]->recursive;
+        for (int i = first; i < last; i++) {
+            Function *f = cg->bottom_up[i];
+            Summary *t = malloc(sizeof(Summary));
+            *t = *s;
+            t->name = f->name;
+            by_id[f->id] = nr_summary;
+            summaries[nr_summary++] = t;
+            info("%s: %d assigned, %d read%s%s%s%s", f->name, t->nr_mod,
+                    t->nr_ref, t->reads_memory ? ", reads memory" : "",
+                    t->writes_memory ? ", writes memory" : "",
+                    t->io ? ", does I/O" : "", t->pure ? ", pure" : "");
+        }
+    }
+}
+
+// the variables of the caller are static like those of the callee, so
+// only a global or a variable of a function in a cycle of calls can be
+// assigned by the callee
+bool call_may_modify(IR *call, char *var_name) {
+    Summary *s = summary_of(call);
+    if (s == NULL) {
+        return is_global(var_name);
+    }
+    return has_name(s->mod, s->nr_mod, var_name);
+}
+
+bool call_may_read(IR *call, char *var_name) {
+    Summary *s = summary_of(call);
+    if (s == NULL) {
+        return is_global(var_name);
+    }
+    return has_name(s->ref, s->nr_ref, var_name);
+}
+
+bool call_reads_memory(IR *call) {
+    Summary *s = summary_of(call);
+    return s == NULL || s->reads_memory;
+}
+
+bool call_writes_memory(IR *call) {
+    Summary *s = summary_of(call);
+    return s == NULL || s->writes_memory;
+}
+
+bool is_pure_call(IR *call) {
+    Summary *s = summary_of(call);
+    return s != NULL && s->pure;
+}
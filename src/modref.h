@@ -0,0 +1,16 @@
+#ifndef __MODREF_H__
+#define __MODREF_H__
+
+#include "common.h"
+#include "ir.h"
+
+// what a call may do, from summaries of the callee and all functions it
+// calls; before the summaries are computed, a call may do anything
+void compute_summaries();
+bool call_may_modify(IR *call, char *var_name);
+bool call_may_read(IR *call, char *var_name);
+bool call_reads_memory(IR *call);
+bool call_writes_memory(IR *call);
+bool is_pure_call(IR *call);
+
+#endif
@@ -3,12 +3,52 @@
 
 extern IRList irList;
 
+int eliminate_dead_functions();
+void eliminate_tail_recursion();
+void inline_functions();
+void propagate_call_constants();
+void eliminate_dead_arguments();
+void promote_globals();
+void compute_summaries();
+void fuse_loops();
+void scalarize_arrays();
+void reassociate();
+void eliminate_redundant_loads();
+void eliminate_partial_redundancy();
+void eliminate_pure_calls();
+void eliminate_dead_stores();
+void eliminate_dead_code_aggressive();
+int fold_comparisons();
+void simplify_branches();
+int eliminate_unreachable_code();
+int convert_ifs();
+void form_superblocks();
+void layout_blocks();
+void reduce_strength();
+void merge_functions();
+
 static bool isConstantAssignment(IR *ir) {
     return ir->kind == IR_ASSIGN 
         && ir->result->kind == TEMP
         && ir->arg1->kind == INT_LITERAL;
 }
 
+static int compare(int a, int relop, int b) {
+    if (relop == RELOP_LT) {
+        return a < b;
+    } else if (relop == RELOP_LE) {
+        return a <= b;
+    } else if (relop == RELOP_GT) {
+        return a > b;
+    } else if (relop == RELOP_GE) {
+        return a >= b;
+    } else if (relop == RELOP_EQ) {
+        return a == b;
+    } else {
+        return a != b;
+    }
+}
+
 static int op_replace(Operand **dest, int temp_no, Operand *repl) {
     if ((*dest)->kind == TEMP && (*dest)->temp_no == temp_no) {
         *dest = repl;
@@ -28,7 +68,8 @@ static int ir_replace_operand(IR *ir, Operand *temp, Operand *repl) {
     if (ir->kind == IR_ADD
             || ir->kind == IR_SUB
             || ir->kind == IR_MUL
-            || ir->kind == IR_DIV) {
+            || ir->kind == IR_DIV
+            || ir->kind == IR_CMP) {
         cnt += op_replace(&ir->arg1, temp_no, repl);
         cnt += op_replace(&ir->arg2, temp_no, repl);
     } else if (ir->kind == IR_ASSIGN
@@ -38,6 +79,10 @@ static int ir_replace_operand(IR *ir, Operand *temp, Operand *repl) {
     } else if (ir->kind == IR_IF) {
         cnt += op_replace(&ir->if_.arg1, temp_no, repl);
         cnt += op_replace(&ir->if_.arg2, temp_no, repl);
+    } else if (ir->kind == IR_SELECT) {
+        cnt += op_replace(&ir->cond, temp_no, repl);
+        cnt += op_replace(&ir->arg1, temp_no, repl);
+        cnt += op_replace(&ir->arg2, temp_no, repl);
     }
     return cnt;
 }
@@ -97,6 +142,15 @@ static IR *ir_compute_constant(IR *ir) {
         } else {
             return NULL;
         }
+    } else if (ir->kind == IR_CMP) {
+        Operand *a = ir->arg1;
+        Operand *b = ir->arg2;
+        if (a->kind == INT_LITERAL && b->kind == INT_LITERAL) {
+            return newAssignInt(ir->result,
+                    compare(a->int_value, ir->relop, b->int_value));
+        } else {
+            return NULL;
+        }
     } else {
         return NULL;
     }
@@ -119,6 +173,7 @@ static bool can_fold_temp(IR *ir1, IR *ir2) {
             && ir1->kind != IR_SUB
             && ir1->kind != IR_MUL
             && ir1->kind != IR_DIV
+            && ir1->kind != IR_CMP
             && ir1->kind != IR_CALL) {
         return false;
     }
@@ -171,8 +226,15 @@ bool is_dead_ir(IR *ir) {
         return false;
     }
     Operand *op = ir->result;
+    if (op->kind == INDIR) {
+        // store through a pointer
+        return false;
+    }
     for (IRNode *q = irList.head; q != NULL; q = q->next) {
-        if (ir_contains(q->ir, op)) {
+        // the address of `*p := x' is a use of p
+        Operand *store = ir_store(q->ir);
+        if (ir_contains(q->ir, op)
+                || store != NULL && op_contains(store->indir_var, op)) {
             return false;
         }
     }
@@ -191,6 +253,16 @@ void eliminate_dead_code() {
 }
 
 void optimize() {
+    eliminate_dead_functions();
+    eliminate_tail_recursion();
+    inline_functions();
+    propagate_call_constants();
+    eliminate_dead_functions();
+    eliminate_dead_arguments();
+    promote_globals();
+    compute_summaries();
+    eliminate_unreachable_code();
+
     // divide block
     int N = IRList_length();
     IRNode **leaders = malloc(N * sizeof(IRNode *));
@@ -217,4 +289,25 @@ void optimize() {
 
     eliminate_dead_code();
 
+    fuse_loops();
+    scalarize_arrays();
+    reassociate();
+    eliminate_redundant_loads();
+    eliminate_partial_redundancy();
+    eliminate_pure_calls();
+    eliminate_dead_stores();
+    eliminate_dead_code_aggressive();
+    fold_comparisons();
+    do {
+        simplify_branches();
+    } while (eliminate_unreachable_code() > 0 || convert_ifs() > 0);
+    // the regions made by tail duplication are optimized again
+    form_superblocks();
+    eliminate_redundant_loads();
+    eliminate_dead_stores();
+    layout_blocks();
+    simplify_branches();
+    eliminate_unreachable_code();
+    reduce_strength();
+    merge_functions();
 }
@@ -0,0 +1,369 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "bitset.h"
+#include "modref.h"
+
+// partial redundancy elimination by lazy code motion, in the edge
+// based formulation of Drechsler and Stadel: an expression is computed
+// on the edges where it becomes anticipated as late as possible, its
+// computations that are then redundant are replaced by a temp, and
+// the computations reaching them save the value in that temp
+
+typedef struct {
+    int kind;
+    Operand *arg1;
+    Operand *arg2;
+    Operand *temp;
+} Expr;
+
+typedef struct {
+    Block *from;  // NULL for the function entry
+    Block *to;
+} Edge;
+
+static int nr_expr;
+static Expr *exprs;
+static int nr_moved;
+
+static bool is_candidate(IR *ir) {
+    if (ir->kind != IR_ADD
+            && ir->kind != IR_SUB
+            && ir->kind != IR_MUL
+            && ir->kind != IR_DIV) {
+        return false;
+    }
+    if (ir->result->kind != TEMP && ir->result->kind != VAR_OPERAND) {
+        return false;
+    }
+    Operand *ops[2] = { ir->arg1, ir->arg2 };
+    for (int i = 0; i < 2; i++) {
+        if (ops[i]->kind != TEMP
+                && ops[i]->kind != VAR_OPERAND
+                && ops[i]->kind != INT_LITERAL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool expr_matches(Expr *e, IR *ir) {
+    if (e->kind != ir->kind) {
+        return false;
+    }
+    if (op_equals(e->arg1, ir->arg1) && op_equals(e->arg2, ir->arg2)) {
+        return true;
+    }
+    return (ir->kind == IR_ADD || ir->kind == IR_MUL)
+        && op_equals(e->arg1, ir->arg2) && op_equals(e->arg2, ir->arg1);
+}
+
+// the expression computed by ir, -1 if none
+static int expr_index(IR *ir) {
+    if (!is_candidate(ir)) {
+        return -1;
+    }
+    for (int i = 0; i < nr_expr; i++) {
+        if (expr_matches(&exprs[i], ir)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void collect_exprs(CFG *cfg) {
+    nr_expr = 0;
+    exprs = NULL;
+    for (IRNode *q = cfg->func->next; q != cfg->end; q = q->next) {
+        IR *ir = q->ir;
+        if (is_candidate(ir) && expr_index(ir) < 0) {
+            exprs = realloc(exprs, (nr_expr + 1) * sizeof(Expr));
+            exprs[nr_expr].kind = ir->kind;
+            exprs[nr_expr].arg1 = ir->arg1;
+            exprs[nr_expr].arg2 = ir->arg2;
+            exprs[nr_expr].temp = NULL;
+            nr_expr++;
+        }
+    }
+}
+
+static bool kills_operand(IR *ir, Operand *op) {
+    Operand *def = ir_def(ir);
+    if (def != NULL && op_equals(def, op)) {
+        return true;
+    }
+    // the callee may assign global variables
+    return ir->kind == IR_CALL
+        && op->kind == VAR_OPERAND && call_may_modify(ir, op->var_name);
+}
+
+static bool kills(IR *ir, Expr *e) {
+    return kills_operand(ir, e->arg1) || kills_operand(ir, e->arg2);
+}
+
+// antloc: computed before any operand is changed in the block
+// comp: computed and no operand is changed after that
+// transp: no operand is changed in the block
+static void local_sets(Block *b, Bitset *antloc, Bitset *comp,
+        Bitset *transp) {
+    Bitset_fill(transp);
+    for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+        int e = expr_index(q->ir);
+        if (e >= 0) {
+            if (Bitset_test(transp, e)) {
+                Bitset_set(antloc, e);
+            }
+            Bitset_set(comp, e);
+        }
+        for (int i = 0; i < nr_expr; i++) {
+            if (kills(q->ir, &exprs[i])) {
+                Bitset_unset(transp, i);
+                Bitset_unset(comp, i);
+            }
+        }
+    }
+}
+
+static Bitset **newBitsets(int n) {
+    Bitset **sets = malloc((n + 1) * sizeof(Bitset *));
+    for (int i = 0; i < n; i++) {
+        sets[i] = newBitset(nr_expr);
+    }
+    return sets;
+}
+
+static Operand *expr_temp(Expr *e) {
+    if (e->temp == NULL) {
+        e->temp = newTemp();
+    }
+    return e->temp;
+}
+
+static IR *compute_into(Operand *result, Expr *e) {
+    if (e->kind == IR_ADD) {
+        return newAdd(result, e->arg1, e->arg2);
+    } else if (e->kind == IR_SUB) {
+        return newSub(result, e->arg1, e->arg2);
+    } else if (e->kind == IR_MUL) {
+        return newMul(result, e->arg1, e->arg2);
+    } else {
+        return newDiv(result, e->arg1, e->arg2);
+    }
+}
+
+// rewrite the block: the first computation of a deleted expression
+// becomes a copy of its temp, and the last computation of an
+// expression with a temp also saves the value
+static void rewrite_block(Block *b, Bitset *delete, Bitset *antloc,
+        Bitset *comp) {
+    Bitset *seen = newBitset(nr_expr);
+    Bitset *killed = newBitset(nr_expr);
+    IRNode *stop = b->last->next;
+    for (IRNode *q = b->first; q != stop; q = q->next) {
+        int i = expr_index(q->ir);
+        if (i >= 0) {
+            Expr *e = &exprs[i];
+            bool first = !Bitset_test(seen, i) && !Bitset_test(killed, i);
+            Bitset_set(seen, i);
+            bool last = Bitset_test(comp, i);
+            for (IRNode *r = q->next; r != stop && last; r = r->next) {
+                if (kills(r->ir, e) || expr_index(r->ir) == i) {
+                    last = false;
+                }
+            }
+            if (first && Bitset_test(delete, i)) {
+                info("redundant: %s", ir_repr(q->ir));
+                q->ir = newAssign(q->ir->result, expr_temp(e));
+                nr_moved++;
+            } else if (last && e->temp != NULL) {
+                Operand *result = q->ir->result;
+                q->ir = compute_into(e->temp, e);
+                bool at_end = q == b->last;
+                q = IRList_insert_after(q, newAssign(result, e->temp));
+                // what is inserted on the edges goes after the copy
+                if (at_end) {
+                    b->last = q;
+                }
+            }
+        }
+        for (int j = 0; j < nr_expr; j++) {
+            if (kills(q->ir, &exprs[j])) {
+                Bitset_set(killed, j);
+            }
+        }
+    }
+}
+
+static void eliminate_function_redundancy(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    int n = cfg->nr_block;
+    collect_exprs(cfg);
+    if (n == 0 || nr_expr == 0) {
+        return;
+    }
+
+    Bitset **antloc = newBitsets(n), **comp = newBitsets(n);
+    Bitset **transp = newBitsets(n);
+    for (int i = 0; i < n; i++) {
+        local_sets(cfg->blocks[i], antloc[i], comp[i], transp[i]);
+    }
+
+    Bitset *tmp = newBitset(nr_expr);
+    bool changed;
+
+    // availability, forward
+    Bitset **avout = newBitsets(n);
+    for (int i = 0; i < n; i++) {
+        Bitset_fill(avout[i]);
+    }
+    do {
+        changed = false;
+        for (int i = 0; i < n; i++) {
+            Block *b = cfg->blocks[i];
+            Bitset_fill(tmp);
+            if (i == 0) {
+                Bitset_clear(tmp);
+            }
+            for (int k = 0; k < b->nr_pred; k++) {
+                Bitset_intersect(tmp, avout[b->pred[k]->id]);
+            }
+            Bitset_intersect(tmp, transp[i]);
+            Bitset_union(tmp, comp[i]);
+            if (!Bitset_equals(tmp, avout[i])) {
+                Bitset_copy(avout[i], tmp);
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    // anticipability, backward
+    Bitset **antin = newBitsets(n), **antout = newBitsets(n);
+    for (int i = 0; i < n; i++) {
+        Bitset_fill(antin[i]);
+    }
+    do {
+        changed = false;
+        for (int i = n - 1; i >= 0; i--) {
+            Block *b = cfg->blocks[i];
+            Bitset_fill(antout[i]);
+            if (b->nr_succ == 0) {
+                Bitset_clear(antout[i]);
+            }
+            for (int k = 0; k < b->nr_succ; k++) {
+                Bitset_intersect(antout[i], antin[b->succ[k]->id]);
+            }
+            Bitset_copy(tmp, antout[i]);
+            Bitset_intersect(tmp, transp[i]);
+            Bitset_union(tmp, antloc[i]);
+            if (!Bitset_equals(tmp, antin[i])) {
+                Bitset_copy(antin[i], tmp);
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    // edges and earliest placement
+    int nr_edge = 1;
+    for (int i = 0; i < n; i++) {
+        nr_edge += cfg->blocks[i]->nr_succ;
+    }
+    Edge *edges = malloc(nr_edge * sizeof(Edge));
+    Bitset **earliest = newBitsets(nr_edge), **later = newBitsets(nr_edge);
+    edges[0].from = NULL;
+    edges[0].to = cfg->blocks[0];
+    Bitset_copy(earliest[0], antin[0]);
+    int m = 1;
+    for (int i = 0; i < n; i++) {
+        Block *b = cfg->blocks[i];
+        for (int k = 0; k < b->nr_succ; k++, m++) {
+            edges[m].from = b;
+            edges[m].to = b->succ[k];
+            // not available at the end of b, and b changes an operand
+            // or the expression is not anticipated at the end of b
+            Bitset_copy(tmp, transp[i]);
+            Bitset_intersect(tmp, antout[i]);
+            Bitset_union(tmp, avout[i]);
+            Bitset_copy(earliest[m], antin[b->succ[k]->id]);
+            Bitset_diff(earliest[m], tmp);
+        }
+    }
+
+    // later, forward over edges
+    Bitset **laterin = newBitsets(n);
+    for (int i = 0; i < n; i++) {
+        Bitset_fill(laterin[i]);
+    }
+    do {
+        changed = false;
+        for (int k = 0; k < nr_edge; k++) {
+            Bitset_copy(later[k], earliest[k]);
+            if (edges[k].from != NULL) {
+                int i = edges[k].from->id;
+                Bitset_copy(tmp, laterin[i]);
+                Bitset_diff(tmp, antloc[i]);
+                Bitset_union(later[k], tmp);
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            Bitset_fill(tmp);
+            for (int k = 0; k < nr_edge; k++) {
+                if (edges[k].to == cfg->blocks[i]) {
+                    Bitset_intersect(tmp, later[k]);
+                }
+            }
+            if (!Bitset_equals(tmp, laterin[i])) {
+                Bitset_copy(laterin[i], tmp);
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    // delete = antloc - laterin, insert = later - laterin of the target
+    Bitset **delete = newBitsets(n);
+    for (int i = 0; i < n; i++) {
+        Bitset_copy(delete[i], antloc[i]);
+        Bitset_diff(delete[i], laterin[i]);
+        for (int e = 0; e < nr_expr; e++) {
+            if (Bitset_test(delete[i], e)) {
+                expr_temp(&exprs[e]);
+            }
+        }
+    }
+    Bitset **insert = newBitsets(nr_edge);
+    for (int k = 0; k < nr_edge; k++) {
+        Bitset_copy(insert[k], later[k]);
+        Bitset_diff(insert[k], laterin[edges[k].to->id]);
+        for (int e = 0; e < nr_expr; e++) {
+            if (Bitset_test(insert[k], e)) {
+                expr_temp(&exprs[e]);
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        rewrite_block(cfg->blocks[i], delete[i], antloc[i], comp[i]);
+    }
+    IR **irs = malloc(nr_expr * sizeof(IR *));
+    for (int k = 0; k < nr_edge; k++) {
+        int nr_ir = 0;
+        for (int e = 0; e < nr_expr; e++) {
+            if (Bitset_test(insert[k], e)) {
+                irs[nr_ir++] = compute_into(exprs[e].temp, &exprs[e]);
+            }
+        }
+        if (nr_ir > 0) {
+            info("insert %d computations on an edge to block %d",
+                    nr_ir, edges[k].to->id);
+            insert_on_edge(cfg, edges[k].from, edges[k].to, irs, nr_ir);
+        }
+    }
+}
+
+void eliminate_partial_redundancy() {
+    info("eliminating partial redundancy...");
+    nr_moved = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        eliminate_function_redundancy(f);
+    }
+    info("%d redundant computations removed", nr_moved);
+}
@@ -0,0 +1,154 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "callgraph.h"
+
+// global promotion: a global that only one function uses becomes one of
+// its variables, when no value of it is carried from one call of the
+// function to the next, which holds for main as it runs once; the
+// storage stays, but the value is dead when the function returns and
+// calls cannot see it, so stores and loads of it can be removed
+//
+// the code generator leaves out the storage of whatever is not used
+
+typedef struct {
+    char *name;
+    Function *func;  // the only function using it, NULL if none
+    bool shared;     // used by several functions or outside any
+    bool escapes;    // its address is taken
+} Use;
+
+static int nr_use;
+static Use *uses;
+static int nr_promoted;
+
+static Use *use_of(char *name) {
+    for (int i = 0; i < nr_use; i++) {
+        if (strcmp(uses[i].name, name) == 0) {
+            return &uses[i];
+        }
+    }
+    uses = realloc(uses, (nr_use + 1) * sizeof(Use));
+    Use *u = &uses[nr_use++];
+    u->name = name;
+    u->func = NULL;
+    u->shared = false;
+    u->escapes = false;
+    return u;
+}
+
+static void note_op(Function *f, Operand *op, bool addr) {
+    if (op == NULL) {
+        return;
+    }
+    if (op->kind == ADDR) {
+        note_op(f, op->addr_var, true);
+    } else if (op->kind == INDIR) {
+        note_op(f, op->indir_var, addr);
+    } else if (op->kind == VAR_OPERAND && is_global(op->var_name)) {
+        Use *u = use_of(op->var_name);
+        if (f == NULL || u->func != NULL && u->func != f) {
+            u->shared = true;
+        }
+        u->func = f;
+        u->escapes = u->escapes || addr;
+    }
+}
+
+static void note_ir(Function *f, IR *ir) {
+    Operand **slots[MAX_READ_SLOT];
+    int n = ir_read_slots(ir, slots);
+    for (int i = 0; i < n; i++) {
+        note_op(f, *slots[i], false);
+    }
+    note_op(f, ir_def(ir), false);
+    note_op(f, ir_store(ir), false);
+}
+
+static bool reads(IR *ir, char *name) {
+    Operand *var = newVariableOperand(name);
+    Operand *store = ir_store(ir);
+    return ir->kind != IR_PARAM && ir_contains(ir, var)
+        || store != NULL && op_contains(store->indir_var, var);
+}
+
+static bool writes(IR *ir, char *name) {
+    Operand *def = ir_def(ir);
+    return def != NULL && def->kind == VAR_OPERAND
+        && strcmp(def->var_name, name) == 0;
+}
+
+// whether the value on entry to f may be read
+static bool is_live_on_entry(Function *f, char *name) {
+    CFG *cfg = newCFG(f->node);
+    if (cfg->nr_block == 0) {
+        return false;
+    }
+    bool *gen = malloc(cfg->nr_block * sizeof(bool));
+    bool *kill = malloc(cfg->nr_block * sizeof(bool));
+    bool *live = malloc(cfg->nr_block * sizeof(bool));
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        gen[i] = false;
+        kill[i] = false;
+        live[i] = false;
+        for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+            if (!kill[i] && reads(q->ir, name)) {
+                gen[i] = true;
+            }
+            if (writes(q->ir, name)) {
+                kill[i] = true;
+            }
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = cfg->nr_block - 1; i >= 0; i--) {
+            Block *b = cfg->blocks[i];
+            bool in = gen[i];
+            for (int k = 0; k < b->nr_succ && !kill[i]; k++) {
+                in = in || live[b->succ[k]->id];
+            }
+            if (in && !live[i]) {
+                live[i] = true;
+                changed = true;
+            }
+        }
+    }
+    return live[0];
+}
+
+void promote_globals() {
+    info("promoting globals...");
+    nr_promoted = 0;
+    nr_use = 0;
+    uses = NULL;
+    CallGraph *cg = newCallGraph();
+    // the code before the first function initializes globals
+    IRNode *first = cg->nr_func > 0 ? cg->funcs[0]->node : NULL;
+    extern IRList irList;
+    for (IRNode *q = irList.head; q != first; q = q->next) {
+        note_ir(NULL, q->ir);
+    }
+    for (int i = 0; i < cg->nr_func; i++) {
+        Function *f = cg->funcs[i];
+        for (IRNode *q = f->node->next; q != f->end; q = q->next) {
+            note_ir(f, q->ir);
+        }
+    }
+    for (int i = 0; i < nr_use; i++) {
+        Use *u = &uses[i];
+        Function *f = u->func;
+        if (u->shared || u->escapes || f->recursive) {
+            continue;
+        }
+        if (f == cg->main ? f->nr_caller == 0
+                : !is_live_on_entry(f, u->name)) {
+            info("global %s is a variable of %s", u->name, f->name);
+            undeclare_global(u->name);
+            nr_promoted++;
+        }
+    }
+    info("%d globals promoted", nr_promoted);
+}
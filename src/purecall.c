@@ -0,0 +1,227 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "callgraph.h"
+#include "modref.h"
+
+// pure call elimination: a call to a pure function whose result is not
+// used is removed with its arguments, and a call with the same
+// arguments as an earlier one in the extended basic block takes the
+// result of that one instead
+
+// result holds what the callee returned for args
+typedef struct {
+    char *callee;
+    int nr_arg;
+    Operand **args;
+    Operand *result;
+} Avail;
+
+typedef struct {
+    int nr_avail;
+    Avail *avail;
+} State;
+
+static CallGraph *cg;
+static Function *func;
+static int nr_removed;
+static int nr_reused;
+static int nr_dead_arg;
+static IRNode **dead_args;
+
+static State *newState() {
+    State *s = malloc(sizeof(State));
+    s->nr_avail = 0;
+    s->avail = NULL;
+    return s;
+}
+
+static State *copy_state(State *s) {
+    State *c = malloc(sizeof(State));
+    c->nr_avail = s->nr_avail;
+    c->avail = malloc(s->nr_avail * sizeof(Avail) + 1);
+    memcpy(c->avail, s->avail, s->nr_avail * sizeof(Avail));
+    return c;
+}
+
+static bool is_used(Operand *temp) {
+    for (IRNode *q = func->node->next; q != func->end; q = q->next) {
+        Operand *store = ir_store(q->ir);
+        if (ir_contains(q->ir, temp)
+                || store != NULL && op_contains(store->indir_var, temp)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool changes(IR *ir, Operand *op) {
+    Operand *def = ir_def(ir);
+    if (def != NULL && op_equals(def, op)) {
+        return true;
+    }
+    return ir->kind == IR_CALL && op->kind == VAR_OPERAND
+        && call_may_modify(ir, op->var_name);
+}
+
+// the argument values of call, NULL if they are not all plain operands
+// that keep their values from the pushes to the call
+static Operand **values_of(IRNode *call, IRNode **args, int n) {
+    Operand **values = malloc((n + 1) * sizeof(Operand *));
+    for (int i = 0; i < n; i++) {
+        Operand *op = args[i]->ir->arg1;
+        if (op->kind != INT_LITERAL && op->kind != TEMP
+                && op->kind != VAR_OPERAND) {
+            return NULL;
+        }
+        for (IRNode *q = args[i]->next; q != call; q = q->next) {
+            if (changes(q->ir, op)) {
+                return NULL;
+            }
+        }
+        values[i] = op;
+    }
+    return values;
+}
+
+static void remove_unused_calls() {
+    IRNode *q = func->node->next;
+    while (q != func->end) {
+        IRNode *next = q->next;
+        IR *ir = q->ir;
+        if (ir->kind == IR_CALL && is_pure_call(ir)
+                && (ir->result == NULL
+                    || ir->result->kind == TEMP && !is_used(ir->result))) {
+            int nr_pending;
+            IRNode **args = find_args(cg, func, q, &nr_pending);
+            if (args != NULL) {
+                info("unused pure call: %s", ir_repr(ir));
+                int n = nr_params(callee_of(cg, ir));
+                for (int i = 0; i < n; i++) {
+                    IRList_remove(args[i]);
+                }
+                IRList_remove(q);
+                nr_removed++;
+            }
+        }
+        q = next;
+    }
+}
+
+static Avail *find_avail(State *s, IR *call, Operand **values, int n) {
+    for (int i = 0; i < s->nr_avail; i++) {
+        Avail *a = &s->avail[i];
+        if (strcmp(a->callee, call->arg1->sym_name) != 0 || a->nr_arg != n) {
+            continue;
+        }
+        bool same = true;
+        for (int k = 0; k < n; k++) {
+            if (!op_equals(a->args[k], values[k])) {
+                same = false;
+            }
+        }
+        if (same) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
+static void kill_changed(State *s, IR *ir) {
+    int n = 0;
+    for (int i = 0; i < s->nr_avail; i++) {
+        Avail *a = &s->avail[i];
+        bool killed = changes(ir, a->result);
+        for (int k = 0; k < a->nr_arg; k++) {
+            if (changes(ir, a->args[k])) {
+                killed = true;
+            }
+        }
+        if (!killed) {
+            s->avail[n++] = *a;
+        }
+    }
+    s->nr_avail = n;
+}
+
+static void process_ir(State *s, IRNode *q) {
+    IR *ir = q->ir;
+    if (ir->kind != IR_CALL || !is_pure_call(ir)
+            || ir->result == NULL || ir->result->kind != TEMP) {
+        kill_changed(s, ir);
+        return;
+    }
+    int nr_pending;
+    IRNode **args = find_args(cg, func, q, &nr_pending);
+    int n = nr_params(callee_of(cg, ir));
+    Operand **values = args == NULL ? NULL : values_of(q, args, n);
+    Avail *a = values == NULL ? NULL : find_avail(s, ir, values, n);
+    if (a != NULL) {
+        info("reuse pure call: %s", ir_repr(ir));
+        q->ir = newAssign(ir->result, a->result);
+        dead_args = realloc(dead_args, (nr_dead_arg + n) * sizeof(IRNode *));
+        for (int i = 0; i < n; i++) {
+            dead_args[nr_dead_arg++] = args[i];
+        }
+        nr_reused++;
+    }
+    kill_changed(s, q->ir);
+    if (a == NULL && values != NULL) {
+        s->avail = realloc(s->avail, (s->nr_avail + 1) * sizeof(Avail));
+        Avail *b = &s->avail[s->nr_avail++];
+        b->callee = ir->arg1->sym_name;
+        b->nr_arg = n;
+        b->args = values;
+        b->result = ir->result;
+    }
+}
+
+static void process_block(CFG *cfg, Block *b, State *s, bool *visited) {
+    visited[b->id] = true;
+    for (IRNode *q = b->first; ; q = q->next) {
+        process_ir(s, q);
+        if (q == b->last) {
+            break;
+        }
+    }
+    for (int i = 0; i < b->nr_succ; i++) {
+        Block *succ = b->succ[i];
+        if (succ->nr_pred == 1 && succ != cfg->blocks[0]
+                && !visited[succ->id]) {
+            process_block(cfg, succ, copy_state(s), visited);
+        }
+    }
+}
+
+static void reuse_calls() {
+    CFG *cfg = newCFG(func->node);
+    bool *visited = malloc((cfg->nr_block + 1) * sizeof(bool));
+    for (int i = 0; i < cfg->nr_block; i++) {
+        visited[i] = false;
+    }
+    nr_dead_arg = 0;
+    dead_args = NULL;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        if (!visited[i] && (i == 0 || b->nr_pred != 1)) {
+            process_block(cfg, b, newState(), visited);
+        }
+    }
+    // the blocks are not needed any more
+    for (int i = 0; i < nr_dead_arg; i++) {
+        IRList_remove(dead_args[i]);
+    }
+}
+
+void eliminate_pure_calls() {
+    info("eliminating pure calls...");
+    nr_removed = 0;
+    nr_reused = 0;
+    cg = newCallGraph();
+    for (int i = 0; i < cg->nr_func; i++) {
+        func = cg->funcs[i];
+        remove_unused_calls();
+        reuse_calls();
+    }
+    info("%d pure calls removed, %d reused", nr_removed, nr_reused);
+}
@@ -0,0 +1,608 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "range.h"
+#include "modref.h"
+
+// value range analysis: the range of every temp and variable is
+// propagated over the CFG and narrowed on the edges of conditional
+// jumps, which also leave facts `a relop b' between the operands that
+// hold until either is redefined; a comparison that the ranges and the
+// facts decide is folded
+
+#define INT_MIN_ (-2147483647LL - 1)
+#define INT_MAX_ 2147483647LL
+// a loop header has its growing bounds widened after it is visited
+// this many times, any block in a cycle that is not a natural loop
+// after MAX_VISIT times
+#define WIDEN_AFTER 3
+#define MAX_VISIT 16
+#define NARROW_ROUNDS 2
+#define MAX_FACT 16
+
+// the possible outcomes of a comparison
+#define LESS 1
+#define EQUAL 2
+#define GREATER 4
+
+typedef struct {
+    Operand *a;
+    Operand *b;
+    int outcomes;
+} Fact;
+
+typedef struct {
+    bool reachable;
+    Range *range;  // by slot
+    int nr_fact;
+    Fact fact[MAX_FACT];
+} State;
+
+struct RangeInfo_ {
+    CFG *cfg;
+    int nr_counted;  // temps numbered from here on are not tracked
+    int nr_var;
+    char **var_name;
+    int nr_slot;
+    State **in;
+};
+
+extern int nr_temp;
+
+static int nr_folded;
+
+static Range full() {
+    Range r = { INT_MIN_, INT_MAX_ };
+    return r;
+}
+
+static Range constant(long long v) {
+    Range r = { v, v };
+    return r;
+}
+
+static Range make_range(long long lo, long long hi) {
+    if (lo < INT_MIN_ || hi > INT_MAX_) {
+        // the value wraps around
+        return full();
+    }
+    Range r = { lo, hi };
+    return r;
+}
+
+static long long min2(long long a, long long b) {
+    return a < b ? a : b;
+}
+
+static long long max2(long long a, long long b) {
+    return a > b ? a : b;
+}
+
+static void add_var(RangeInfo *ri, char *name) {
+    for (int i = 0; i < ri->nr_var; i++) {
+        if (strcmp(ri->var_name[i], name) == 0) {
+            return;
+        }
+    }
+    ri->var_name = realloc(ri->var_name, (ri->nr_var + 1) * sizeof(char *));
+    ri->var_name[ri->nr_var++] = name;
+}
+
+// the slot of a tracked operand, -1 if it is not tracked
+static int slot_of(RangeInfo *ri, Operand *op) {
+    if (op->kind == TEMP) {
+        return op->temp_no < ri->nr_counted ? op->temp_no : -1;
+    } else if (op->kind == VAR_OPERAND) {
+        for (int i = 0; i < ri->nr_var; i++) {
+            if (strcmp(ri->var_name[i], op->var_name) == 0) {
+                return ri->nr_counted + i;
+            }
+        }
+    }
+    return -1;
+}
+
+static State *newState(RangeInfo *ri, bool reachable) {
+    State *s = malloc(sizeof(State));
+    s->reachable = reachable;
+    s->range = malloc(ri->nr_slot * sizeof(Range));
+    for (int i = 0; i < ri->nr_slot; i++) {
+        s->range[i] = full();
+    }
+    s->nr_fact = 0;
+    return s;
+}
+
+static void copy_state(RangeInfo *ri, State *dst, State *src) {
+    dst->reachable = src->reachable;
+    memcpy(dst->range, src->range, ri->nr_slot * sizeof(Range));
+    dst->nr_fact = src->nr_fact;
+    memcpy(dst->fact, src->fact, src->nr_fact * sizeof(Fact));
+}
+
+static Range range_of(RangeInfo *ri, State *s, Operand *op) {
+    if (op->kind == INT_LITERAL) {
+        return constant(op->int_value);
+    }
+    int i = slot_of(ri, op);
+    return i < 0 ? full() : s->range[i];
+}
+
+static Range mul_range(Range a, Range b) {
+    long long p[4] = { a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi };
+    long long lo = p[0], hi = p[0];
+    for (int i = 1; i < 4; i++) {
+        lo = min2(lo, p[i]);
+        hi = max2(hi, p[i]);
+    }
+    return make_range(lo, hi);
+}
+
+static Range eval(RangeInfo *ri, State *s, IR *ir) {
+    Range a, b;
+    if (ir->kind == IR_ASSIGN) {
+        return range_of(ri, s, ir->arg1);
+    } else if (ir->kind == IR_CMP) {
+        return make_range(0, 1);
+    } else if (ir->kind == IR_SELECT) {
+        a = range_of(ri, s, ir->arg1);
+        b = range_of(ri, s, ir->arg2);
+        return make_range(min2(a.lo, b.lo), max2(a.hi, b.hi));
+    } else if (ir->kind != IR_ADD && ir->kind != IR_SUB
+            && ir->kind != IR_MUL && ir->kind != IR_DIV
+            && ir->kind != IR_SHR) {
+        return full();
+    }
+    a = range_of(ri, s, ir->arg1);
+    b = range_of(ri, s, ir->arg2);
+    if (ir->kind == IR_ADD) {
+        return make_range(a.lo + b.lo, a.hi + b.hi);
+    } else if (ir->kind == IR_SUB) {
+        return make_range(a.lo - b.hi, a.hi - b.lo);
+    } else if (ir->kind == IR_MUL) {
+        return mul_range(a, b);
+    } else if (ir->kind == IR_DIV && b.lo == b.hi && b.lo > 0) {
+        // division by a positive constant keeps the order
+        return make_range(a.lo / b.lo, a.hi / b.lo);
+    } else if (ir->kind == IR_SHR && b.lo == b.hi
+            && b.lo >= 0 && b.lo < 32) {
+        return make_range(a.lo >> b.lo, a.hi >> b.lo);
+    }
+    return full();
+}
+
+static bool fact_mentions(Fact *f, Operand *op) {
+    return op_equals(f->a, op) || op_equals(f->b, op);
+}
+
+static void kill_facts(State *s, Operand *op) {
+    int n = 0;
+    for (int i = 0; i < s->nr_fact; i++) {
+        if (!fact_mentions(&s->fact[i], op)) {
+            s->fact[n++] = s->fact[i];
+        }
+    }
+    s->nr_fact = n;
+}
+
+// globals may be changed by a call
+static void kill_modified(RangeInfo *ri, State *s, IR *call) {
+    for (int i = 0; i < ri->nr_var; i++) {
+        if (!call_may_modify(call, ri->var_name[i])) {
+            continue;
+        }
+        s->range[ri->nr_counted + i] = full();
+        int n = 0;
+        for (int k = 0; k < s->nr_fact; k++) {
+            Fact *f = &s->fact[k];
+            if (!(f->a->kind == VAR_OPERAND
+                        && strcmp(f->a->var_name, ri->var_name[i]) == 0)
+                    && !(f->b->kind == VAR_OPERAND
+                        && strcmp(f->b->var_name, ri->var_name[i]) == 0)) {
+                s->fact[n++] = *f;
+            }
+        }
+        s->nr_fact = n;
+    }
+}
+
+static void transfer(RangeInfo *ri, State *s, IR *ir) {
+    Operand *def = ir_def(ir);
+    if (def != NULL) {
+        Range r = eval(ri, s, ir);
+        kill_facts(s, def);
+        int i = slot_of(ri, def);
+        if (i >= 0) {
+            s->range[i] = r;
+        }
+    }
+    if (ir->kind == IR_CALL) {
+        kill_modified(ri, s, ir);
+    }
+}
+
+static int outcomes_of(int relop) {
+    if (relop == RELOP_LT) {
+        return LESS;
+    } else if (relop == RELOP_LE) {
+        return LESS | EQUAL;
+    } else if (relop == RELOP_GT) {
+        return GREATER;
+    } else if (relop == RELOP_GE) {
+        return GREATER | EQUAL;
+    } else if (relop == RELOP_EQ) {
+        return EQUAL;
+    } else {
+        return LESS | GREATER;
+    }
+}
+
+// the outcomes of comparing b with a from those of comparing a with b
+static int swap_outcomes(int outcomes) {
+    return (outcomes & EQUAL)
+        | ((outcomes & LESS) ? GREATER : 0)
+        | ((outcomes & GREATER) ? LESS : 0);
+}
+
+static bool is_tracked(Operand *op) {
+    return op->kind == TEMP || op->kind == VAR_OPERAND;
+}
+
+// the outcomes of comparing a with b that the state allows
+static int possible_outcomes(RangeInfo *ri, State *s, Operand *a,
+        Operand *b) {
+    Range ra = range_of(ri, s, a);
+    Range rb = range_of(ri, s, b);
+    int outcomes = 0;
+    if (ra.lo < rb.hi) {
+        outcomes |= LESS;
+    }
+    if (ra.lo <= rb.hi && rb.lo <= ra.hi) {
+        outcomes |= EQUAL;
+    }
+    if (ra.hi > rb.lo) {
+        outcomes |= GREATER;
+    }
+    if (op_equals(a, b) && is_tracked(a)) {
+        outcomes &= EQUAL;
+    }
+    for (int i = 0; i < s->nr_fact; i++) {
+        Fact *f = &s->fact[i];
+        if (op_equals(f->a, a) && op_equals(f->b, b)) {
+            outcomes &= f->outcomes;
+        } else if (op_equals(f->a, b) && op_equals(f->b, a)) {
+            outcomes &= swap_outcomes(f->outcomes);
+        }
+    }
+    return outcomes;
+}
+
+// 1 if `a relop b' always holds, 0 if it never does, -1 if unknown
+static int decide(RangeInfo *ri, State *s, Operand *a, int relop,
+        Operand *b) {
+    int possible = possible_outcomes(ri, s, a, b);
+    int holds = outcomes_of(relop);
+    if ((possible & ~holds) == 0) {
+        return 1;
+    } else if ((possible & holds) == 0) {
+        return 0;
+    }
+    return -1;
+}
+
+static void add_fact(State *s, Operand *a, int outcomes, Operand *b) {
+    for (int i = 0; i < s->nr_fact; i++) {
+        Fact *f = &s->fact[i];
+        if (op_equals(f->a, a) && op_equals(f->b, b)) {
+            f->outcomes &= outcomes;
+            return;
+        } else if (op_equals(f->a, b) && op_equals(f->b, a)) {
+            f->outcomes &= swap_outcomes(outcomes);
+            return;
+        }
+    }
+    if (s->nr_fact < MAX_FACT) {
+        Fact *f = &s->fact[s->nr_fact++];
+        f->a = a;
+        f->b = b;
+        f->outcomes = outcomes;
+    }
+}
+
+static void narrow_to(RangeInfo *ri, State *s, Operand *op, Range r) {
+    int i = slot_of(ri, op);
+    if (i < 0) {
+        return;
+    }
+    s->range[i].lo = max2(s->range[i].lo, r.lo);
+    s->range[i].hi = min2(s->range[i].hi, r.hi);
+    if (s->range[i].lo > s->range[i].hi) {
+        s->reachable = false;
+    }
+}
+
+// the state on the edge where `a relop b' holds
+static void narrow(RangeInfo *ri, State *s, Operand *a, int relop,
+        Operand *b) {
+    Range ra = range_of(ri, s, a);
+    Range rb = range_of(ri, s, b);
+    if (relop == RELOP_GT || relop == RELOP_GE) {
+        Operand *t = a;
+        a = b;
+        b = t;
+        Range rt = ra;
+        ra = rb;
+        rb = rt;
+        relop = relop == RELOP_GT ? RELOP_LT : RELOP_LE;
+    }
+    if (relop == RELOP_LT) {
+        narrow_to(ri, s, a, make_range(INT_MIN_, rb.hi - 1));
+        narrow_to(ri, s, b, make_range(ra.lo + 1, INT_MAX_));
+    } else if (relop == RELOP_LE) {
+        narrow_to(ri, s, a, make_range(INT_MIN_, rb.hi));
+        narrow_to(ri, s, b, make_range(ra.lo, INT_MAX_));
+    } else if (relop == RELOP_EQ) {
+        narrow_to(ri, s, a, rb);
+        narrow_to(ri, s, b, ra);
+    } else if (rb.lo == rb.hi) {
+        // a != b only moves a bound of a that equals b
+        if (ra.lo == rb.lo) {
+            narrow_to(ri, s, a, make_range(ra.lo + 1, INT_MAX_));
+        } else if (ra.hi == rb.lo) {
+            narrow_to(ri, s, a, make_range(INT_MIN_, ra.hi - 1));
+        }
+    }
+    if ((possible_outcomes(ri, s, a, b) & outcomes_of(relop)) == 0) {
+        s->reachable = false;
+    }
+    if (is_tracked(a) && (is_tracked(b) || b->kind == INT_LITERAL)) {
+        add_fact(s, a, outcomes_of(relop), b);
+    }
+}
+
+// the state on the edge from b to its k-th successor
+static void edge_state(RangeInfo *ri, State *out, Block *b, int k,
+        State *s) {
+    copy_state(ri, s, out);
+    IR *ir = b->last->ir;
+    if (!s->reachable || b->nr_succ != 2 || ir->kind != IR_IF) {
+        return;
+    }
+    int relop = k == 1 ? ir->if_.relop : invert_relop(ir->if_.relop);
+    narrow(ri, s, ir->if_.arg1, relop, ir->if_.arg2);
+    if (b->succ[0] == b->succ[1]) {
+        // both edges lead to the same block
+        copy_state(ri, s, out);
+    }
+}
+
+// merge s into dst, returns whether dst changed
+static bool meet(RangeInfo *ri, State *dst, State *s, bool widen) {
+    if (!s->reachable) {
+        return false;
+    }
+    if (!dst->reachable) {
+        copy_state(ri, dst, s);
+        return true;
+    }
+    bool changed = false;
+    for (int i = 0; i < ri->nr_slot; i++) {
+        Range *r = &dst->range[i];
+        if (s->range[i].lo < r->lo) {
+            r->lo = widen ? INT_MIN_ : s->range[i].lo;
+            changed = true;
+        }
+        if (s->range[i].hi > r->hi) {
+            r->hi = widen ? INT_MAX_ : s->range[i].hi;
+            changed = true;
+        }
+    }
+    int n = 0;
+    for (int i = 0; i < dst->nr_fact; i++) {
+        Fact *f = &dst->fact[i];
+        int outcomes = LESS | EQUAL | GREATER;
+        for (int k = 0; k < s->nr_fact; k++) {
+            Fact *g = &s->fact[k];
+            if (op_equals(f->a, g->a) && op_equals(f->b, g->b)) {
+                outcomes = g->outcomes;
+            } else if (op_equals(f->a, g->b) && op_equals(f->b, g->a)) {
+                outcomes = swap_outcomes(g->outcomes);
+            }
+        }
+        if ((f->outcomes | outcomes) != f->outcomes) {
+            changed = true;
+        }
+        f->outcomes |= outcomes;
+        if (f->outcomes != (LESS | EQUAL | GREATER)) {
+            dst->fact[n++] = *f;
+        }
+    }
+    dst->nr_fact = n;
+    return changed;
+}
+
+// merge the states on the edges into b, returns whether they changed
+static bool visit(RangeInfo *ri, State **out, Block *b, State *edge,
+        bool widen) {
+    State *in = ri->in[b->id];
+    bool changed = false;
+    for (int p = 0; p < b->nr_pred; p++) {
+        Block *pred = b->pred[p];
+        for (int k = 0; k < pred->nr_succ; k++) {
+            if (pred->succ[k] != b) {
+                continue;
+            }
+            edge_state(ri, out[pred->id], pred, k, edge);
+            if (meet(ri, in, edge, widen)) {
+                changed = true;
+            }
+        }
+    }
+    copy_state(ri, out[b->id], in);
+    if (in->reachable) {
+        for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+            transfer(ri, out[b->id], q->ir);
+        }
+    }
+    return changed;
+}
+
+static bool is_loop_header(Block *b) {
+    for (int i = 0; i < b->nr_pred; i++) {
+        if (is_back_edge(b->pred[i], b)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void collect_vars(RangeInfo *ri, Operand *op) {
+    if (op == NULL) {
+        return;
+    }
+    if (op->kind == VAR_OPERAND) {
+        add_var(ri, op->var_name);
+    } else if (op->kind == INDIR) {
+        collect_vars(ri, op->indir_var);
+    }
+}
+
+RangeInfo *compute_ranges(CFG *cfg) {
+    RangeInfo *ri = malloc(sizeof(RangeInfo));
+    ri->cfg = cfg;
+    ri->nr_counted = nr_temp + 1;
+    ri->nr_var = 0;
+    ri->var_name = NULL;
+    for (IRNode *q = cfg->func->next; q != cfg->end; q = q->next) {
+        Operand **slots[MAX_READ_SLOT];
+        int n = ir_read_slots(q->ir, slots);
+        for (int i = 0; i < n; i++) {
+            collect_vars(ri, *slots[i]);
+        }
+        collect_vars(ri, ir_def(q->ir));
+    }
+    ri->nr_slot = ri->nr_counted + ri->nr_var;
+    compute_dominators(cfg);
+    int n = cfg->nr_block;
+    ri->in = malloc(n * sizeof(State *));
+    State **out = malloc(n * sizeof(State *));
+    int *visits = malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        ri->in[i] = newState(ri, i == 0);
+        out[i] = newState(ri, false);
+        visits[i] = 0;
+    }
+    State *edge = newState(ri, false);
+    bool changed = n > 0;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < n; i++) {
+            Block *b = cfg->blocks[i];
+            visits[i]++;
+            bool widen = visits[i] > WIDEN_AFTER && is_loop_header(b)
+                || visits[i] > MAX_VISIT;
+            if (visit(ri, out, b, edge, widen)) {
+                changed = true;
+            }
+        }
+    }
+    // the widened bounds are narrowed again by recomputing the states
+    // from those of the predecessors
+    for (int round = 0; round < NARROW_ROUNDS; round++) {
+        for (int i = 1; i < n; i++) {
+            ri->in[i]->reachable = false;
+            visit(ri, out, cfg->blocks[i], edge, false);
+        }
+    }
+    return ri;
+}
+
+Range range_before(RangeInfo *ri, IRNode *q, Operand *op) {
+    CFG *cfg = ri->cfg;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        for (IRNode *p = b->first; p != b->last->next; p = p->next) {
+            if (p != q) {
+                continue;
+            }
+            if (!ri->in[i]->reachable) {
+                return full();
+            }
+            State *s = newState(ri, true);
+            copy_state(ri, s, ri->in[i]);
+            for (p = b->first; p != q; p = p->next) {
+                transfer(ri, s, p->ir);
+            }
+            return range_of(ri, s, op);
+        }
+    }
+    return full();
+}
+
+// whether q may run, as far as the decided branches tell
+bool is_reached(RangeInfo *ri, IRNode *q) {
+    CFG *cfg = ri->cfg;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        for (IRNode *p = b->first; p != b->last->next; p = p->next) {
+            if (p == q) {
+                return ri->in[i]->reachable;
+            }
+        }
+    }
+    return false;
+}
+
+static void fold_function(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    RangeInfo *ri = compute_ranges(cfg);
+    State *s = newState(ri, false);
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        if (!ri->in[i]->reachable) {
+            continue;
+        }
+        copy_state(ri, s, ri->in[i]);
+        IRNode *stop = b->last->next;
+        IRNode *q = b->first;
+        while (q != stop) {
+            IRNode *next = q->next;
+            IR *ir = q->ir;
+            if (ir->kind == IR_CMP) {
+                int value = decide(ri, s, ir->arg1, ir->relop, ir->arg2);
+                if (value >= 0) {
+                    info("fold %s to %d", ir_repr(ir), value);
+                    q->ir = newAssign(ir->result, newIntLiteral(value));
+                    nr_folded++;
+                }
+            } else if (ir->kind == IR_IF) {
+                int value = decide(ri, s, ir->if_.arg1, ir->if_.relop,
+                        ir->if_.arg2);
+                if (value == 1) {
+                    info("fold %s to a jump", ir_repr(ir));
+                    q->ir = newGoto(ir->if_.label);
+                    nr_folded++;
+                } else if (value == 0) {
+                    info("fold %s away", ir_repr(ir));
+                    IRList_remove(q);
+                    nr_folded++;
+                    q = next;
+                    continue;
+                }
+            }
+            transfer(ri, s, q->ir);
+            q = next;
+        }
+    }
+}
+
+// returns the number of comparisons folded
+int fold_comparisons() {
+    info("folding comparisons by value ranges...");
+    nr_folded = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        fold_function(f);
+    }
+    info("%d comparisons folded", nr_folded);
+    return nr_folded;
+}
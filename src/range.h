@@ -0,0 +1,20 @@
+#ifndef __RANGE_H__
+#define __RANGE_H__
+
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+
+// the values an integer may take, both bounds inclusive
+typedef struct {
+    long long lo;
+    long long hi;
+} Range;
+
+typedef struct RangeInfo_ RangeInfo;
+
+RangeInfo *compute_ranges(CFG *cfg);
+Range range_before(RangeInfo *info, IRNode *q, Operand *op);
+bool is_reached(RangeInfo *info, IRNode *q);
+
+#endif
@@ -0,0 +1,424 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "modref.h"
+
+// reassociation: a tree of `+' and `-', or of `*', whose inner temps
+// are used only once is flattened into its terms; the constants are
+// folded into one, the other terms are sorted by rank, the loop depth
+// where they are defined, so that loop invariant terms are grouped,
+// and the tree is rebuilt balanced to shorten the dependence chain
+
+#define MAX_TERM 32
+
+typedef struct {
+    Operand *op;
+    int sign;  // -1 for a subtracted term
+    int rank;
+} Term;
+
+typedef struct {
+    int *nr_def;
+    int *nr_use;
+    IRNode **def_node;
+    int *def_pos;
+    int *rank;       // for temps, the deepest loop defining them
+    int nr_counted;
+    int nr_var;
+    char **var_name;
+    int *var_rank;
+    Block *block;    // the block being rewritten
+    int nr_term;
+    Term terms[MAX_TERM];
+    int nr_inner;
+    IRNode *inner[MAX_TERM];
+    int constant;
+    int nr_const;
+    bool additive;
+} Reassoc;
+
+extern int nr_temp;
+
+static int nr_reassociated;
+
+static bool in_class(Reassoc *r, IR *ir) {
+    if (r->additive) {
+        return ir->kind == IR_ADD || ir->kind == IR_SUB;
+    } else {
+        return ir->kind == IR_MUL;
+    }
+}
+
+static void count_use(Reassoc *r, Operand *op) {
+    if (op->kind == TEMP) {
+        r->nr_use[op->temp_no]++;
+    } else if (op->kind == INDIR) {
+        count_use(r, op->indir_var);
+    }
+}
+
+static int var_rank(Reassoc *r, char *name) {
+    for (int i = 0; i < r->nr_var; i++) {
+        if (strcmp(r->var_name[i], name) == 0) {
+            return r->var_rank[i];
+        }
+    }
+    return 0;
+}
+
+static void set_var_rank(Reassoc *r, char *name, int rank) {
+    for (int i = 0; i < r->nr_var; i++) {
+        if (strcmp(r->var_name[i], name) == 0) {
+            if (rank > r->var_rank[i]) {
+                r->var_rank[i] = rank;
+            }
+            return;
+        }
+    }
+    r->var_name = realloc(r->var_name, (r->nr_var + 1) * sizeof(char *));
+    r->var_rank = realloc(r->var_rank, (r->nr_var + 1) * sizeof(int));
+    r->var_name[r->nr_var] = name;
+    r->var_rank[r->nr_var] = rank;
+    r->nr_var++;
+}
+
+static int rank_of(Reassoc *r, Operand *op) {
+    if (op->kind == INT_LITERAL || op->kind == ADDR) {
+        return 0;
+    } else if (op->kind == TEMP) {
+        return r->rank[op->temp_no];
+    } else if (op->kind == VAR_OPERAND) {
+        return var_rank(r, op->var_name);
+    } else {
+        // a load may change on every iteration
+        return r->block->loop_depth;
+    }
+}
+
+// the definition of a temp that is only used by the tree at pos
+static IRNode *inner_def(Reassoc *r, Operand *op, int pos) {
+    // temps made by earlier rewrites are not counted
+    if (op->kind != TEMP || op->temp_no >= r->nr_counted) {
+        return NULL;
+    }
+    int t = op->temp_no;
+    if (r->nr_def[t] != 1 || r->nr_use[t] != 1 || r->def_pos[t] >= pos) {
+        return NULL;
+    }
+    IRNode *q = r->def_node[t];
+    for (IRNode *p = r->block->first; p != r->block->last->next;
+            p = p->next) {
+        if (p == q) {
+            return in_class(r, q->ir) ? q : NULL;
+        }
+    }
+    return NULL;
+}
+
+// add the terms of op, returns the height of its tree or -1 if there
+// are too many terms
+static int collect(Reassoc *r, Operand *op, int sign, int pos) {
+    IRNode *q = inner_def(r, op, pos);
+    if (q == NULL) {
+        if (op->kind == INT_LITERAL) {
+            // wrap around like the target does
+            unsigned c = r->constant;
+            if (r->additive) {
+                r->constant = c + sign * op->int_value;
+            } else {
+                r->constant = c * op->int_value;
+            }
+            r->nr_const++;
+            return 0;
+        }
+        if (r->nr_term == MAX_TERM) {
+            return -1;
+        }
+        Term *term = &r->terms[r->nr_term++];
+        term->op = op;
+        term->sign = sign;
+        term->rank = rank_of(r, op);
+        return 0;
+    }
+    if (r->nr_inner == MAX_TERM) {
+        return -1;
+    }
+    r->inner[r->nr_inner++] = q;
+    IR *ir = q->ir;
+    int pos1 = r->def_pos[op->temp_no];
+    int h1 = collect(r, ir->arg1, sign, pos1);
+    int h2 = collect(r, ir->arg2, ir->kind == IR_SUB ? -sign : sign, pos1);
+    if (h1 < 0 || h2 < 0) {
+        return -1;
+    }
+    return 1 + (h1 > h2 ? h1 : h2);
+}
+
+static bool is_inner(Reassoc *r, IRNode *q) {
+    for (int i = 0; i < r->nr_inner; i++) {
+        if (r->inner[i] == q) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool term_changed_by(Term *term, IR *ir) {
+    Operand *op = term->op;
+    Operand *def = ir_def(ir);
+    if (def != NULL && (op_equals(def, op)
+                || op->kind == INDIR && op_equals(def, op->indir_var))) {
+        return true;
+    }
+    if (op->kind == INDIR && (ir_store(ir) != NULL
+                || ir->kind == IR_CALL && call_writes_memory(ir)
+                || ir->kind == IR_READ)) {
+        return true;
+    }
+    return ir->kind == IR_CALL
+        && op->kind == VAR_OPERAND && call_may_modify(ir, op->var_name);
+}
+
+// the terms must have the same values at the root as in the tree
+static bool terms_unchanged(Reassoc *r, IRNode *root) {
+    IRNode *first = r->inner[0];
+    for (int i = 1; i < r->nr_inner; i++) {
+        IRNode *q = r->inner[i];
+        if (r->def_pos[q->ir->result->temp_no]
+                < r->def_pos[first->ir->result->temp_no]) {
+            first = q;
+        }
+    }
+    for (IRNode *q = first; q != root; q = q->next) {
+        if (is_inner(r, q)) {
+            continue;
+        }
+        for (int i = 0; i < r->nr_term; i++) {
+            if (term_changed_by(&r->terms[i], q->ir)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static IR *new_arith(int kind, Operand *result, Operand *a, Operand *b) {
+    if (kind == IR_ADD) {
+        return newAdd(result, a, b);
+    } else if (kind == IR_SUB) {
+        return newSub(result, a, b);
+    } else {
+        return newMul(result, a, b);
+    }
+}
+
+// a balanced tree over terms lo..hi-1, inserted before root
+static Operand *build(Reassoc *r, Term **terms, int lo, int hi,
+        IRNode *root) {
+    if (hi - lo == 1) {
+        return terms[lo]->op;
+    }
+    int mid = (lo + hi) / 2;
+    Operand *a = build(r, terms, lo, mid, root);
+    Operand *b = build(r, terms, mid, hi, root);
+    Operand *t = newTemp();
+    IRList_insert_before(root,
+            new_arith(r->additive ? IR_ADD : IR_MUL, t, a, b));
+    return t;
+}
+
+// the top of the tree over all the terms, computing result
+static IR *build_root(Reassoc *r, Term **terms, int n, IRNode *root,
+        Operand *result) {
+    if (n == 1) {
+        return newAssign(result, terms[0]->op);
+    }
+    Operand *a = build(r, terms, 0, n / 2, root);
+    Operand *b = build(r, terms, n / 2, n, root);
+    return new_arith(r->additive ? IR_ADD : IR_MUL, result, a, b);
+}
+
+static int compare_terms(const void *a, const void *b) {
+    const Term *x = *(const Term **) a, *y = *(const Term **) b;
+    if (x->rank != y->rank) {
+        return x->rank - y->rank;
+    }
+    return x - y;  // stable
+}
+
+static int sorted_height(int n) {
+    int h = 0;
+    while ((1 << h) < n) {
+        h++;
+    }
+    return h;
+}
+
+static void rewrite(Reassoc *r, IRNode *root, int height) {
+    Term *pos[MAX_TERM], *neg[MAX_TERM];
+    int nr_pos = 0, nr_neg = 0;
+    bool sorted = true;
+    for (int i = 0; i < r->nr_term; i++) {
+        Term *term = &r->terms[i];
+        if (term->sign > 0) {
+            pos[nr_pos++] = term;
+        } else {
+            neg[nr_neg++] = term;
+        }
+        if (i > 0 && term->rank < r->terms[i - 1].rank) {
+            sorted = false;
+        }
+    }
+    qsort(pos, nr_pos, sizeof(Term *), compare_terms);
+    qsort(neg, nr_neg, sizeof(Term *), compare_terms);
+
+    bool has_const = r->additive ? r->constant != 0 : r->constant != 1;
+    int new_height = sorted_height(nr_pos) > sorted_height(nr_neg)
+        ? sorted_height(nr_pos) : sorted_height(nr_neg);
+    new_height += (nr_pos > 0 && nr_neg > 0) + has_const;
+    if (r->nr_const < 2 && new_height >= height && sorted) {
+        return;
+    }
+
+    info("reassociate %s", ir_repr(root->ir));
+    Operand *result = root->ir->result;
+    Operand *c = newIntLiteral(r->constant);
+    IR *ir;
+    if (!r->additive && r->constant == 0) {
+        ir = newAssign(result, c);
+    } else if (nr_neg == 0 && nr_pos > 0 && !has_const) {
+        ir = build_root(r, pos, nr_pos, root, result);
+    } else {
+        Operand *p = nr_pos > 0 ? build(r, pos, 0, nr_pos, root) : NULL;
+        Operand *n = nr_neg > 0 ? build(r, neg, 0, nr_neg, root) : NULL;
+        if (p != NULL && n != NULL && has_const) {
+            Operand *t = newTemp();
+            IRList_insert_before(root, newSub(t, p, n));
+            ir = newAdd(result, t, c);
+        } else if (p != NULL && n != NULL) {
+            ir = newSub(result, p, n);
+        } else if (p != NULL) {
+            ir = new_arith(r->additive ? IR_ADD : IR_MUL, result, p, c);
+        } else if (n != NULL) {
+            ir = newSub(result, c, n);
+        } else {
+            ir = newAssign(result, c);
+        }
+    }
+    root->ir = ir;
+    for (int i = 0; i < r->nr_inner; i++) {
+        IRList_remove(r->inner[i]);
+    }
+    nr_reassociated++;
+}
+
+static void reassociate_tree(Reassoc *r, IRNode *root, int pos) {
+    IR *ir = root->ir;
+    r->nr_term = 0;
+    r->nr_inner = 0;
+    r->nr_const = 0;
+    r->constant = r->additive ? 0 : 1;
+    int h1 = collect(r, ir->arg1, 1, pos);
+    int h2 = collect(r, ir->arg2, ir->kind == IR_SUB ? -1 : 1, pos);
+    if (h1 < 0 || h2 < 0 || r->nr_term + r->nr_const < 3
+            || r->nr_inner == 0 || !terms_unchanged(r, root)) {
+        return;
+    }
+    rewrite(r, root, 1 + (h1 > h2 ? h1 : h2));
+}
+
+static void reassociate_function(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    if (cfg->nr_block == 0) {
+        return;
+    }
+    compute_dominators(cfg);
+    Loop *loops;
+    find_loops(cfg, &loops);
+
+    Reassoc *r = malloc(sizeof(Reassoc));
+    int n = nr_temp + 1;
+    r->nr_counted = n;
+    r->nr_def = malloc(n * sizeof(int));
+    r->nr_use = malloc(n * sizeof(int));
+    r->def_node = malloc(n * sizeof(IRNode *));
+    r->def_pos = malloc(n * sizeof(int));
+    r->rank = malloc(n * sizeof(int));
+    r->nr_var = 0;
+    r->var_name = NULL;
+    r->var_rank = NULL;
+    for (int i = 0; i < n; i++) {
+        r->nr_def[i] = 0;
+        r->nr_use[i] = 0;
+        r->rank[i] = 0;
+    }
+    IRNode **use_node = malloc(n * sizeof(IRNode *));
+    int pos = 0;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        for (IRNode *q = b->first; q != b->last->next; q = q->next, pos++) {
+            IR *ir = q->ir;
+            Operand **slots[MAX_READ_SLOT];
+            int nr_slot = ir_read_slots(ir, slots);
+            for (int k = 0; k < nr_slot; k++) {
+                count_use(r, *slots[k]);
+                if ((*slots[k])->kind == TEMP) {
+                    use_node[(*slots[k])->temp_no] = q;
+                }
+            }
+            if (ir_store(ir) != NULL) {
+                count_use(r, ir_store(ir));
+            }
+            Operand *def = ir_def(ir);
+            if (def != NULL && def->kind == TEMP) {
+                int t = def->temp_no;
+                r->nr_def[t]++;
+                r->def_node[t] = q;
+                r->def_pos[t] = pos;
+                if (b->loop_depth > r->rank[t]) {
+                    r->rank[t] = b->loop_depth;
+                }
+            } else if (def != NULL) {
+                set_var_rank(r, def->var_name, b->loop_depth);
+            }
+        }
+    }
+
+    pos = 0;
+    for (int i = 0; i < cfg->nr_block; i++) {
+        Block *b = cfg->blocks[i];
+        r->block = b;
+        IRNode *stop = b->last->next;
+        IRNode *q = b->first;
+        while (q != stop) {
+            IRNode *next = q->next;
+            IR *ir = q->ir;
+            if (ir->kind == IR_ADD || ir->kind == IR_SUB
+                    || ir->kind == IR_MUL) {
+                r->additive = ir->kind != IR_MUL;
+                Operand *def = ir->result;
+                IRNode *next_use = NULL;
+                if (def->kind == TEMP && r->nr_def[def->temp_no] == 1
+                        && r->nr_use[def->temp_no] == 1) {
+                    next_use = use_node[def->temp_no];
+                }
+                // a tree is rewritten at its root, whose result is
+                // not used by another node of the same kind
+                if (next_use == NULL || !in_class(r, next_use->ir)) {
+                    reassociate_tree(r, q, pos);
+                }
+            }
+            q = next;
+            pos++;
+        }
+    }
+}
+
+void reassociate() {
+    info("reassociating expressions...");
+    nr_reassociated = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        reassociate_function(f);
+    }
+    info("%d expressions reassociated", nr_reassociated);
+}
@@ -0,0 +1,131 @@
+#include "common.h"
+#include "ir.h"
+#include "rename.h"
+
+struct Renaming_ {
+    int nr_temp;      // temps numbered below are renamed
+    Operand **temps;  // by number, NULL if not seen yet
+    int nr_label;
+    int *label_from;
+    Label **label_to;
+    int nr_var;
+    char **var_from;
+    Operand **var_to;
+};
+
+extern int nr_temp;
+
+Renaming *newRenaming() {
+    Renaming *r = malloc(sizeof(Renaming));
+    r->nr_temp = nr_temp + 1;
+    r->temps = malloc(r->nr_temp * sizeof(Operand *));
+    for (int i = 0; i < r->nr_temp; i++) {
+        r->temps[i] = NULL;
+    }
+    r->nr_label = 0;
+    r->label_from = NULL;
+    r->label_to = NULL;
+    r->nr_var = 0;
+    r->var_from = NULL;
+    r->var_to = NULL;
+    return r;
+}
+
+void rename_var(Renaming *r, char *name, Operand *op) {
+    int n = r->nr_var + 1;
+    r->var_from = realloc(r->var_from, n * sizeof(char *));
+    r->var_to = realloc(r->var_to, n * sizeof(Operand *));
+    r->var_from[n - 1] = name;
+    r->var_to[n - 1] = op;
+    r->nr_var = n;
+}
+
+static Operand *rename_op(Renaming *r, Operand *op) {
+    if (op->kind == TEMP) {
+        if (op->temp_no >= r->nr_temp) {
+            return op;
+        }
+        if (r->temps[op->temp_no] == NULL) {
+            r->temps[op->temp_no] = newTemp();
+        }
+        return r->temps[op->temp_no];
+    } else if (op->kind == VAR_OPERAND) {
+        for (int i = 0; i < r->nr_var; i++) {
+            if (strcmp(r->var_from[i], op->var_name) == 0) {
+                return r->var_to[i];
+            }
+        }
+        return op;
+    } else if (op->kind == ADDR) {
+        return newAddr(rename_op(r, op->addr_var));
+    } else if (op->kind == INDIR) {
+        Operand *indir = newIndir(rename_op(r, op->indir_var));
+        ArrayRef *ref = op->array_ref;
+        if (ref != NULL) {
+            indir->array_ref = newArrayRef();
+            indir->array_ref->base = rename_op(r, ref->base);
+            for (int i = 0; i < ref->nr_dim; i++) {
+                ArrayRef_add_dim(indir->array_ref,
+                        rename_op(r, ref->index[i]), ref->width[i]);
+            }
+        }
+        return indir;
+    } else {
+        return op;
+    }
+}
+
+static Label *rename_label(Renaming *r, int label_no) {
+    for (int i = 0; i < r->nr_label; i++) {
+        if (r->label_from[i] == label_no) {
+            return r->label_to[i];
+        }
+    }
+    int n = r->nr_label + 1;
+    r->label_from = realloc(r->label_from, n * sizeof(int));
+    r->label_to = realloc(r->label_to, n * sizeof(Label *));
+    r->label_from[n - 1] = label_no;
+    r->label_to[n - 1] = newLabel();
+    r->nr_label = n;
+    return r->label_to[n - 1];
+}
+
+static bool has_result(IR *ir) {
+    return ir->kind == IR_ASSIGN
+        || ir->kind == IR_ADD
+        || ir->kind == IR_SUB
+        || ir->kind == IR_MUL
+        || ir->kind == IR_DIV
+        || ir->kind == IR_CALL
+        || ir->kind == IR_CMP
+        || ir->kind == IR_SELECT
+        || ir->kind == IR_SHL
+        || ir->kind == IR_SHR
+        || ir->kind == IR_SHRU
+        || ir->kind == IR_MULH;
+}
+
+IR *rename_ir(Renaming *r, IR *ir) {
+    IR *copy = copy_ir(ir);
+    Operand **slots[MAX_READ_SLOT];
+    int n = ir_read_slots(copy, slots);
+    for (int i = 0; i < n; i++) {
+        *slots[i] = rename_op(r, *slots[i]);
+    }
+    if (has_result(copy) && copy->result != NULL) {
+        copy->result = rename_op(r, copy->result);
+    } else if (copy->kind == IR_READ) {
+        copy->arg1 = rename_op(r, copy->arg1);
+    } else if (copy->kind == IR_ALLOC) {
+        copy->alloc.var = rename_op(r, copy->alloc.var);
+    } else if (copy->kind == IR_LABEL) {
+        copy->label.label_no =
+            label_number(rename_label(r, copy->label.label_no));
+    } else if (copy->kind == IR_GOTO) {
+        copy->goto_.label =
+            rename_label(r, label_number(copy->goto_.label));
+    } else if (copy->kind == IR_IF) {
+        copy->if_.label = rename_label(r, label_number(copy->if_.label));
+    }
+    return copy;
+}
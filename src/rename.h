@@ -0,0 +1,15 @@
+#ifndef __RENAME_H__
+#define __RENAME_H__
+
+#include "common.h"
+#include "ir.h"
+
+// the renaming of a copy of code: the temps and labels existing when it
+// is created get fresh ones, and the variables added get a replacement
+typedef struct Renaming_ Renaming;
+
+Renaming *newRenaming();
+void rename_var(Renaming *r, char *name, Operand *op);
+IR *rename_ir(Renaming *r, IR *ir);
+
+#endif
@@ -0,0 +1,109 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "alias.h"
+
+// scalar replacement: a small local array whose address does not
+// escape and which is only accessed at constant offsets gets a temp
+// for each element, and the accesses use the temps instead
+
+#define MAX_SCALAR_SIZE 64
+
+static int nr_replaced;
+
+// the slots of ir that may hold a `*p', returns the number of slots
+static int access_slots(IR *ir, Operand **slots[]) {
+    int n = ir_read_slots(ir, slots);
+    if (ir_store(ir) != NULL) {
+        slots[n++] = &ir->result;
+    }
+    return n;
+}
+
+// a `*p' in any other place, such as `READ *p', is not handled
+static bool has_other_access(IR *ir) {
+    Operand *op = NULL;
+    if (ir->kind == IR_CALL) {
+        op = ir->result;
+    } else if (ir->kind == IR_READ || ir->kind == IR_PARAM) {
+        op = ir->arg1;
+    }
+    return op != NULL && op->kind == INDIR;
+}
+
+static bool can_scalarize(CFG *cfg, IR *alloc) {
+    int alloc_no = alloc->alloc.var->temp_no;
+    int size = alloc->alloc.size;
+    if (size > MAX_SCALAR_SIZE || size % 4 != 0 || alloc_escapes(alloc_no)) {
+        return false;
+    }
+    for (IRNode *q = cfg->func->next; q != cfg->end; q = q->next) {
+        if (has_other_access(q->ir)) {
+            return false;
+        }
+        Operand **slots[MAX_READ_SLOT + 1];
+        int n = access_slots(q->ir, slots);
+        for (int i = 0; i < n; i++) {
+            Operand *op = *slots[i];
+            if (op->kind != INDIR
+                    || !may_point_to(op->indir_var, alloc_no)) {
+                continue;
+            }
+            int offset;
+            if (alloc_of(op->indir_var) != alloc_no
+                    || !offset_of(op->indir_var, &offset)
+                    || offset < 0 || offset >= size || offset % 4 != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void scalarize(CFG *cfg, IRNode *alloc) {
+    int alloc_no = alloc->ir->alloc.var->temp_no;
+    int nr_elem = alloc->ir->alloc.size / 4;
+    Operand **elem = malloc(nr_elem * sizeof(Operand *));
+    for (int i = 0; i < nr_elem; i++) {
+        elem[i] = NULL;
+    }
+    info("scalar replacement of %s", op_repr(alloc->ir->alloc.var));
+    for (IRNode *q = cfg->func->next; q != cfg->end; q = q->next) {
+        Operand **slots[MAX_READ_SLOT + 1];
+        int n = access_slots(q->ir, slots);
+        for (int i = 0; i < n; i++) {
+            Operand *op = *slots[i];
+            int offset;
+            if (op->kind != INDIR
+                    || alloc_of(op->indir_var) != alloc_no
+                    || !offset_of(op->indir_var, &offset)) {
+                continue;
+            }
+            if (elem[offset / 4] == NULL) {
+                elem[offset / 4] = newTemp();
+            }
+            *slots[i] = elem[offset / 4];
+        }
+    }
+    // the address computations are left for dead store elimination
+    IRList_remove(alloc);
+    nr_replaced++;
+}
+
+void scalarize_arrays() {
+    info("scalar replacement of arrays...");
+    alias_analyze();
+    nr_replaced = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        CFG *cfg = newCFG(f);
+        IRNode *q = f->next;
+        while (q != cfg->end) {
+            IRNode *next = q->next;
+            if (q->ir->kind == IR_ALLOC && can_scalarize(cfg, q->ir)) {
+                scalarize(cfg, q);
+            }
+            q = next;
+        }
+    }
+    info("%d arrays replaced by scalars", nr_replaced);
+}
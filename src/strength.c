@@ -0,0 +1,253 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+#include "range.h"
+
+extern IRList irList;
+
+// strength reduction of multiplications and divisions by constants:
+// a product is computed by shifts and adds of the signed digits of the
+// constant, and a signed quotient by the high word of a product with a
+// magic number, as in Hacker's Delight, corrected to round toward zero;
+// the correction is left out for a dividend known not to be negative
+
+// the most instructions that replace one `*'
+#define MAX_MUL_COST 2
+#define MAX_CODE 8
+
+typedef struct {
+    int nr_ir;
+    IR *irs[MAX_CODE];
+} Code;
+
+static int nr_reduced;
+
+static bool is_power_of_two(unsigned x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static int log_of(unsigned x) {
+    int k = 0;
+    while (x > 1) {
+        x >>= 1;
+        k++;
+    }
+    return k;
+}
+
+// the result of the last instruction is left to the caller
+static Operand *emit(Code *code, IR *ir) {
+    code->irs[code->nr_ir++] = ir;
+    return ir->result;
+}
+
+// replace the instruction at q by the code, whose last instruction
+// computes the old result
+static void replace(IRNode *q, Code *code) {
+    info("reduce %s", ir_repr(q->ir));
+    IR *last = code->irs[code->nr_ir - 1];
+    last->result = q->ir->result;
+    for (int i = 0; i < code->nr_ir - 1; i++) {
+        IRList_insert_before(q, code->irs[i]);
+    }
+    q->ir = last;
+    nr_reduced++;
+}
+
+// the nonzero digits of c in non-adjacent form, returns their number;
+// a carry out of the word is dropped like the target does
+static int signed_digits(unsigned c, int *shift, int *sign) {
+    int n = 0;
+    for (int k = 0; k < 32 && c != 0; k++, c >>= 1) {
+        if (c & 1) {
+            int d = (c & 3) == 3 ? -1 : 1;
+            shift[n] = k;
+            sign[n] = d;
+            n++;
+            c -= d;
+        }
+    }
+    return n;
+}
+
+static Operand *shifted(Code *code, Operand *x, int k) {
+    if (k == 0) {
+        return x;
+    }
+    return emit(code, newShl(newTemp(), x, newIntLiteral(k)));
+}
+
+// x * c as the sum of x shifted by the digits of c
+static bool reduce_mul(IRNode *q, Operand *x, int c) {
+    int shift[32], sign[32];
+    int n = signed_digits(c, shift, sign);
+    int first = 0;
+    while (first < n && sign[first] < 0) {
+        first++;
+    }
+    bool negate = first == n;
+    int cost = n - 1 + negate;
+    for (int i = 0; i < n; i++) {
+        cost += shift[i] > 0;
+    }
+    if (n == 0 || cost > MAX_MUL_COST) {
+        return false;
+    }
+    Code code;
+    code.nr_ir = 0;
+    if (negate) {
+        // every digit is negative, the sum is negated at the end
+        first = 0;
+        for (int i = 0; i < n; i++) {
+            sign[i] = -sign[i];
+        }
+    }
+    Operand *acc = shifted(&code, x, shift[first]);
+    for (int i = 0; i < n; i++) {
+        if (i == first) {
+            continue;
+        }
+        Operand *term = shifted(&code, x, shift[i]);
+        acc = emit(&code, sign[i] > 0 ? newAdd(newTemp(), acc, term)
+                : newSub(newTemp(), acc, term));
+    }
+    if (negate) {
+        emit(&code, newSub(newTemp(), newIntLiteral(0), acc));
+    }
+    if (code.nr_ir == 0) {
+        emit(&code, newAssign(newTemp(), acc));
+    }
+    replace(q, &code);
+    return true;
+}
+
+// x / 2^k rounded toward zero: a negative x is biased by 2^k - 1
+static void divide_by_power(Code *code, Operand *x, bool nonnegative,
+        int k) {
+    Operand *biased = x;
+    if (!nonnegative) {
+        Operand *bias;
+        if (k == 1) {
+            bias = emit(code, newShru(newTemp(), x, newIntLiteral(31)));
+        } else {
+            Operand *sign = emit(code,
+                    newShr(newTemp(), x, newIntLiteral(31)));
+            bias = emit(code,
+                    newShru(newTemp(), sign, newIntLiteral(32 - k)));
+        }
+        biased = emit(code, newAdd(newTemp(), x, bias));
+    }
+    emit(code, newShr(newTemp(), biased, newIntLiteral(k)));
+}
+
+// the magic number and shift for a signed division by d, where
+// |d| >= 2, from Hacker's Delight, figure 10-1
+static void magic(int d, int *m, int *s) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? -(unsigned) d : (unsigned) d;
+    unsigned t = two31 + ((unsigned) d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    int p = 31;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || q1 == delta && r1 == 0);
+    *m = (int) (q2 + 1);
+    if (d < 0) {
+        *m = -*m;
+    }
+    *s = p - 32;
+}
+
+static void divide_by_magic(Code *code, Operand *x, bool nonnegative,
+        int d) {
+    int m, s;
+    magic(d, &m, &s);
+    Operand *q = emit(code, newMulh(newTemp(), x, newIntLiteral(m)));
+    if (d > 0 && m < 0) {
+        q = emit(code, newAdd(newTemp(), q, x));
+    } else if (d < 0 && m > 0) {
+        q = emit(code, newSub(newTemp(), q, x));
+    }
+    if (s > 0) {
+        q = emit(code, newShr(newTemp(), q, newIntLiteral(s)));
+    }
+    if (d > 0 && nonnegative) {
+        return;
+    }
+    // add one to a negative quotient
+    Operand *sign = emit(code, newShru(newTemp(), q, newIntLiteral(31)));
+    emit(code, newAdd(newTemp(), q, sign));
+}
+
+static bool reduce_div(IRNode *q, Operand *x, bool nonnegative, int d) {
+    if (d == 0) {
+        return false;
+    }
+    Code code;
+    code.nr_ir = 0;
+    unsigned ad = d < 0 ? -(unsigned) d : (unsigned) d;
+    if (d == 1) {
+        emit(&code, newAssign(newTemp(), x));
+    } else if (d == -1) {
+        emit(&code, newSub(newTemp(), newIntLiteral(0), x));
+    } else if (is_power_of_two(ad)) {
+        divide_by_power(&code, x, nonnegative, log_of(ad));
+        if (d < 0) {
+            Operand *q = code.irs[code.nr_ir - 1]->result;
+            emit(&code, newSub(newTemp(), newIntLiteral(0), q));
+        }
+    } else {
+        divide_by_magic(&code, x, nonnegative, d);
+    }
+    replace(q, &code);
+    return true;
+}
+
+static void reduce_function(IRNode *func) {
+    CFG *cfg = newCFG(func);
+    RangeInfo *ranges = compute_ranges(cfg);
+    IRNode *last = cfg->end != NULL ? cfg->end->prev : irList.tail;
+    // backwards, so that the ranges before q are not yet rewritten
+    for (IRNode *q = last, *prev; q != func; q = prev) {
+        prev = q->prev;
+        IR *ir = q->ir;
+        Operand *a = ir->arg1;
+        Operand *b = ir->arg2;
+        if (ir->kind == IR_MUL && b->kind == INT_LITERAL
+                && a->kind != INT_LITERAL) {
+            reduce_mul(q, a, b->int_value);
+        } else if (ir->kind == IR_MUL && a->kind == INT_LITERAL
+                && b->kind != INT_LITERAL) {
+            reduce_mul(q, b, a->int_value);
+        } else if (ir->kind == IR_DIV && b->kind == INT_LITERAL
+                && a->kind != INT_LITERAL) {
+            bool nonnegative = range_before(ranges, q, a).lo >= 0;
+            reduce_div(q, a, nonnegative, b->int_value);
+        }
+    }
+}
+
+void reduce_strength() {
+    info("reducing multiplications and divisions...");
+    nr_reduced = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        reduce_function(f);
+    }
+    info("%d instructions reduced", nr_reduced);
+}
@@ -0,0 +1,148 @@
+#include "common.h"
+#include "ir.h"
+#include "cfg.h"
+
+// superblock formation by tail duplication: a small join block that
+// a predecessor reaches by `GOTO' is copied to the end of that
+// predecessor, so the path through it becomes one region with a
+// single entry; the hottest predecessors, by loop depth, are handled
+// first while the code growth stays within a budget
+
+#define MAX_TAIL_SIZE 8
+#define MAX_GROWTH_PERCENT 25
+#define MAX_ROUND 4
+
+typedef struct {
+    Block *pred;
+    Block *tail;
+} Candidate;
+
+static int nr_duplicated;
+
+// the number of instructions to copy, -1 if the block cannot be copied
+static int tail_size(CFG *cfg, Block *b) {
+    int size = 0;
+    for (IRNode *q = b->first; q != b->last->next; q = q->next) {
+        int kind = q->ir->kind;
+        if (kind == IR_ALLOC || kind == IR_PARAM) {
+            return -1;
+        }
+        if (kind != IR_LABEL) {
+            size++;
+        }
+    }
+    int kind = b->last->ir->kind;
+    if (kind != IR_GOTO && kind != IR_RETURN && b->id + 1 == cfg->nr_block) {
+        // falls off the end of the function
+        return -1;
+    }
+    return size;
+}
+
+static bool is_loop_header(Block *b) {
+    for (int i = 0; i < b->nr_pred; i++) {
+        if (is_back_edge(b->pred[i], b)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_candidate(CFG *cfg, Block *pred, Block *tail) {
+    if (pred->last->ir->kind != IR_GOTO || pred == tail
+            || tail->id == 0 || tail->nr_pred < 2
+            || !pred->reachable || is_loop_header(tail)) {
+        return false;
+    }
+    int size = tail_size(cfg, tail);
+    return size > 0 && size <= MAX_TAIL_SIZE;
+}
+
+static int compare_candidates(const void *a, const void *b) {
+    const Candidate *x = a, *y = b;
+    if (x->pred->loop_depth != y->pred->loop_depth) {
+        return y->pred->loop_depth - x->pred->loop_depth;
+    }
+    return x->pred->id - y->pred->id;
+}
+
+// replace the jump at the end of pred by a copy of tail
+static void duplicate(CFG *cfg, Block *pred, Block *tail) {
+    IRNode *jump = pred->last;
+    IRNode *pos = jump;
+    info("duplicate block %d into block %d", tail->id, pred->id);
+    for (IRNode *q = tail->first; q != tail->last->next; q = q->next) {
+        if (q->ir->kind != IR_LABEL) {
+            pos = IRList_insert_after(pos, copy_ir(q->ir));
+        }
+    }
+    int kind = tail->last->ir->kind;
+    if (kind != IR_GOTO && kind != IR_RETURN) {
+        Block *next = cfg->blocks[tail->id + 1];
+        IRList_insert_after(pos, newGoto(block_label(next)));
+    }
+    IRList_remove(jump);
+}
+
+// returns the number of instructions added
+static int form_round(IRNode *func, int budget) {
+    CFG *cfg = newCFG(func);
+    int n = cfg->nr_block;
+    if (n == 0) {
+        return 0;
+    }
+    compute_dominators(cfg);
+    Loop *loops;
+    find_loops(cfg, &loops);
+    Candidate *cands = malloc((n + 1) * sizeof(Candidate));
+    int nr_cand = 0;
+    for (int i = 0; i < n; i++) {
+        Block *b = cfg->blocks[i];
+        if (b->nr_succ == 1 && is_candidate(cfg, b, b->succ[0])) {
+            cands[nr_cand].pred = b;
+            cands[nr_cand].tail = b->succ[0];
+            nr_cand++;
+        }
+    }
+    qsort(cands, nr_cand, sizeof(Candidate), compare_candidates);
+
+    // a block that is changed is not copied in the same round
+    bool *changed = malloc(n * sizeof(bool));
+    for (int i = 0; i < n; i++) {
+        changed[i] = false;
+    }
+    int growth = 0;
+    for (int i = 0; i < nr_cand; i++) {
+        Block *pred = cands[i].pred;
+        Block *tail = cands[i].tail;
+        int size = tail_size(cfg, tail);
+        if (changed[tail->id] || growth + size > budget) {
+            continue;
+        }
+        duplicate(cfg, pred, tail);
+        changed[pred->id] = true;
+        growth += size;
+        nr_duplicated++;
+    }
+    return growth;
+}
+
+void form_superblocks() {
+    info("forming superblocks...");
+    nr_duplicated = 0;
+    for (IRNode *f = next_function(NULL); f != NULL; f = next_function(f)) {
+        int size = 0;
+        for (IRNode *q = f->next; q != next_function(f); q = q->next) {
+            size++;
+        }
+        int budget = size * MAX_GROWTH_PERCENT / 100;
+        for (int round = 0; round < MAX_ROUND && budget > 0; round++) {
+            int growth = form_round(f, budget);
+            if (growth == 0) {
+                break;
+            }
+            budget -= growth;
+        }
+    }
+    info("%d blocks duplicated", nr_duplicated);
+}
@@ -0,0 +1,70 @@
+#include "common.h"
+#include "ir.h"
+#include "callgraph.h"
+
+// tail recursion elimination: `t := CALL f; RETURN t' in f itself sets
+// the parameters to the arguments and jumps back to the start of the
+// body, so the recursion becomes a loop; calls to other functions in
+// tail position are left to the code generator, which reuses the
+// argument area of the caller for them
+
+static int nr_eliminated;
+
+static bool is_tail_call(IRNode *q) {
+    IR *ir = q->ir;
+    if (ir->kind != IR_CALL || ir->result == NULL || q->next == NULL) {
+        return false;
+    }
+    IR *next = q->next->ir;
+    return next->kind == IR_RETURN && op_equals(next->arg1, ir->result);
+}
+
+static void eliminate_in(CallGraph *cg, Function *f) {
+    int n = nr_params(f);
+    IRNode *last_param = f->node;
+    for (int i = 0; i < n; i++) {
+        last_param = last_param->next;
+    }
+    Label *start = NULL;
+    for (IRNode *q = last_param->next; q != f->end; q = q->next) {
+        if (!is_tail_call(q) || strcmp(q->ir->arg1->sym_name, f->name) != 0) {
+            continue;
+        }
+        int nr_pending;
+        IRNode **args = find_args(cg, f, q, &nr_pending);
+        if (args == NULL || nr_pending > 0) {
+            continue;
+        }
+        info("tail recursion in %s", f->name);
+        if (start == NULL) {
+            start = newLabel();
+            IRList_insert_after(last_param, newLabelIR(start));
+        }
+        // all arguments are evaluated before the first parameter is set
+        IRNode *param = f->node->next;
+        for (int i = 0; i < n; i++, param = param->next) {
+            Operand *value = args[i]->ir->arg1;
+            if (value->kind == TEMP || value->kind == INT_LITERAL) {
+                IRList_remove(args[i]);
+            } else {
+                Operand *temp = newTemp();
+                args[i]->ir = newAssign(temp, value);
+                value = temp;
+            }
+            IRList_insert_before(q, newAssign(param->ir->arg1, value));
+        }
+        IRList_remove(q->next);
+        q->ir = newGoto(start);
+        nr_eliminated++;
+    }
+}
+
+void eliminate_tail_recursion() {
+    info("eliminating tail recursion...");
+    nr_eliminated = 0;
+    CallGraph *cg = newCallGraph();
+    for (int i = 0; i < cg->nr_func; i++) {
+        eliminate_in(cg, cg->funcs[i]);
+    }
+    info("%d tail calls eliminated", nr_eliminated);
+}
@@ -70,6 +70,11 @@ static void visitExtDef(void *node) {
 
 static void visitExtDecList(void *node) {
     ExtDecList *extDecList = (ExtDecList *)node;
+    VarDec *vd = extDecList->varDec;
+    while (vd->vardec_kind == VAR_DEC_T_DIM) {
+        vd = vd->dim.varDec;
+    }
+    declare_global(vd->id_text);
     translate_VarDec(extDecList->varDec, false);
     if (extDecList->extDecList != NULL) {
         visit(extDecList->extDecList);
@@ -365,24 +370,150 @@ void translate_Args(Args *args) {
     gen(newArg(temp));
 }
 
-void translate_Subscript(Exp *exp, Operand *offset) {
+void translate_Subscript(Exp *exp, Operand *offset, ArrayRef *ref) {
     if (exp->exp_kind != EXP_T_SUBSCRIPT) {
         gen(newAssignInt(offset, 0));
         return;
     }
     Operand *sub_offset = newTemp();
-    translate_Subscript(exp->subscript.array, sub_offset);
+    translate_Subscript(exp->subscript.array, sub_offset, ref);
     Operand *this_offset = newTemp();
     Operand *index = newTemp();
     translate_Exp(exp->subscript.index, index);
     int w = width(exp->attr_type);
+    ArrayRef_add_dim(ref, index, w);
     gen(newMul(this_offset, index, newIntLiteral(w)));
     gen(newAdd(offset, sub_offset, this_offset));
 }
 
+static bool has_side_effect(Exp *exp) {
+    if (exp->exp_kind == EXP_T_INFIX) {
+        return exp->infix.op == ASSIGNOP
+            || has_side_effect(exp->infix.exp_left)
+            || has_side_effect(exp->infix.exp_right);
+    } else if (exp->exp_kind == EXP_T_PAREN) {
+        return has_side_effect(exp->paren.exp);
+    } else if (exp->exp_kind == EXP_T_UNARY) {
+        return has_side_effect(exp->unary.exp);
+    } else if (exp->exp_kind == EXP_T_CALL) {
+        return true;
+    } else if (exp->exp_kind == EXP_T_SUBSCRIPT) {
+        return has_side_effect(exp->subscript.array)
+            || has_side_effect(exp->subscript.index);
+    } else if (exp->exp_kind == EXP_T_DOT) {
+        return has_side_effect(exp->dot.exp);
+    } else {
+        return false;
+    }
+}
+
+// an array element place is only read or written when it is used,
+// so the index variables of its ArrayRef must not change before that
+static void check_deferred_access(Operand *place, Exp *later) {
+    if (place->kind == INDIR && has_side_effect(later)) {
+        place->array_ref = NULL;
+    }
+}
+
+static bool is_boolean(Exp *exp) {
+    if (exp->exp_kind == EXP_T_PAREN) {
+        return is_boolean(exp->paren.exp);
+    }
+    return exp->exp_kind == EXP_T_INFIX && exp->infix.op == RELOP
+        || exp->exp_kind == EXP_T_INFIX && exp->infix.op == AND
+        || exp->exp_kind == EXP_T_INFIX && exp->infix.op == OR
+        || exp->exp_kind == EXP_T_UNARY && exp->unary.op == NOT;
+}
+
+// an expression that may be evaluated even if the program would not
+// evaluate it: no side effects, no division by zero and no array
+// access out of bounds
+static bool can_speculate(Exp *exp) {
+    if (exp->exp_kind == EXP_T_INFIX) {
+        return exp->infix.op != ASSIGNOP
+            && exp->infix.op != DIV
+            && can_speculate(exp->infix.exp_left)
+            && can_speculate(exp->infix.exp_right);
+    } else if (exp->exp_kind == EXP_T_PAREN) {
+        return can_speculate(exp->paren.exp);
+    } else if (exp->exp_kind == EXP_T_UNARY) {
+        return can_speculate(exp->unary.exp);
+    } else {
+        return exp->exp_kind == EXP_T_ID
+            || exp->exp_kind == EXP_T_INT
+            || exp->exp_kind == EXP_T_FLOAT;
+    }
+}
+
+// can the value of a boolean expression be computed without branches
+static bool can_set_on_compare(Exp *exp) {
+    if (exp->exp_kind == EXP_T_PAREN) {
+        return can_set_on_compare(exp->paren.exp);
+    } else if (exp->exp_kind == EXP_T_UNARY) {
+        return !is_boolean(exp->unary.exp)
+            || can_set_on_compare(exp->unary.exp);
+    } else if (exp->infix.op == RELOP) {
+        return true;
+    }
+    Exp *left = exp->infix.exp_left;
+    Exp *right = exp->infix.exp_right;
+    return (!is_boolean(left) || can_set_on_compare(left))
+        && can_speculate(right)
+        && (!is_boolean(right) || can_set_on_compare(right));
+}
+
+// place := 1 if exp is not zero, else 0
+static void translate_Truth(Exp *exp, Operand *place);
+
+static void translate_SetOnCompare(Exp *exp, Operand *place) {
+    if (exp->exp_kind == EXP_T_PAREN) {
+        translate_SetOnCompare(exp->paren.exp, place);
+
+    } else if (exp->exp_kind == EXP_T_UNARY) {
+        Operand *temp = newTemp();
+        translate_Truth(exp->unary.exp, temp);
+        gen(newCmp(place, temp, RELOP_EQ, newIntLiteral(0)));
+
+    } else if (exp->infix.op == RELOP) {
+        Operand *temp1 = newTemp();
+        Operand *temp2 = newTemp();
+        translate_Exp(exp->infix.exp_left, temp1);
+        translate_Exp(exp->infix.exp_right, temp2);
+        check_deferred_access(temp1, exp->infix.exp_right);
+        gen(newCmp(place, temp1, exp->infix.op_yylval, temp2));
+
+    } else {
+        // both sides are 0 or 1
+        Operand *temp1 = newTemp();
+        Operand *temp2 = newTemp();
+        Operand *sum = newTemp();
+        translate_Truth(exp->infix.exp_left, temp1);
+        translate_Truth(exp->infix.exp_right, temp2);
+        gen(newAdd(sum, temp1, temp2));
+        if (exp->infix.op == AND) {
+            gen(newCmp(place, sum, RELOP_GT, newIntLiteral(1)));
+        } else {
+            gen(newCmp(place, sum, RELOP_NE, newIntLiteral(0)));
+        }
+    }
+}
+
+static void translate_Truth(Exp *exp, Operand *place) {
+    if (is_boolean(exp)) {
+        translate_SetOnCompare(exp, place);
+    } else {
+        Operand *temp = newTemp();
+        translate_Exp(exp, temp);
+        gen(newCmp(place, temp, RELOP_NE, newIntLiteral(0)));
+    }
+}
+
 void translate_Exp(Exp *exp, Operand *place) {
 
-    if (exp->exp_kind == EXP_T_INFIX && exp->infix.op == RELOP
+    if (is_boolean(exp) && can_set_on_compare(exp)) {
+        translate_SetOnCompare(exp, place);
+
+    } else if (exp->exp_kind == EXP_T_INFIX && exp->infix.op == RELOP
             || exp->exp_kind == EXP_T_INFIX && exp->infix.op == AND
             || exp->exp_kind == EXP_T_INFIX && exp->infix.op == OR
             || exp->exp_kind == EXP_T_UNARY && exp->unary.op == NOT) {
@@ -403,6 +534,7 @@ void translate_Exp(Exp *exp, Operand *place) {
         Operand *temp2 = newTemp();
         translate_Exp(left, temp1);
         translate_Exp(right, temp2);
+        check_deferred_access(temp1, right);
 
         if (exp->infix.op == PLUS) {
             gen(newAdd(place, temp1, temp2));
@@ -460,7 +592,8 @@ void translate_Exp(Exp *exp, Operand *place) {
         // offaddr = x + offset
         // x = *offaddr
         Operand *offset = newTemp();
-        translate_Subscript(exp, offset);
+        ArrayRef *ref = newArrayRef();
+        translate_Subscript(exp, offset, ref);
         Exp *base = exp;
         while (base->exp_kind == EXP_T_SUBSCRIPT) {
             base = base->subscript.array;
@@ -472,7 +605,9 @@ void translate_Exp(Exp *exp, Operand *place) {
         Operand *var = newVariableOperand(base->id_text);
         Operand *offaddr = newTemp();
         gen(newAdd(offaddr, var, offset));
+        ref->base = var;
         memcpy(place, newIndir(offaddr), sizeof(Operand));
+        place->array_ref = ref;
 
     } else if (exp->exp_kind == EXP_T_DOT) {
         error(exp, "dot operation not supported");
@@ -555,6 +690,7 @@ static void translate_Condition(Exp *exp, Label *L_true, Label *L_false) {
         Operand *temp2 = newTemp();
         translate_Exp(exp->infix.exp_left, temp1);
         translate_Exp(exp->infix.exp_right, temp2);
+        check_deferred_access(temp1, exp->infix.exp_right);
         gen(newIf(temp1, exp->infix.op_yylval, temp2, L_true));
         gen(newGoto(L_false));
 
@@ -592,7 +728,7 @@ void generate_intercode() {
     visit(root);
     if (can_translate) {
         int irlist_length_before_optimizing = IRList_length();
-//        optimize();
+        optimize();
 //        IRList_print_2();
         int irlist_length_after_optimizing = IRList_length();
         info("[Before optimizing] %d IR lines",
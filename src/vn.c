@@ -0,0 +1,186 @@
+#include "vn.h"
+#include "modref.h"
+
+extern int nr_temp;
+
+typedef struct {
+    int kind;
+    int vn1, vn2;
+    int vn;
+} Expr;
+
+struct VNState_ {
+    int *temp_vn;  // 0 for unknown
+    int nr_var;
+    char **var_name;
+    int *var_vn;
+    int nr_expr;
+    Expr *expr;
+};
+
+typedef struct {
+    int kind;
+    int value;
+    int vn;
+} Const;
+
+static int nr_vn;
+static int nr_const;
+static Const *consts;
+static int nr_state_temp;
+
+// start a new numbering, the temps created from now on get no number
+void vn_init() {
+    nr_vn = 0;
+    nr_const = 0;
+    consts = NULL;
+    nr_state_temp = nr_temp;
+}
+
+VNState *newVNState() {
+    VNState *s = malloc(sizeof(VNState));
+    s->temp_vn = malloc((nr_state_temp + 1) * sizeof(int));
+    memset(s->temp_vn, 0, (nr_state_temp + 1) * sizeof(int));
+    s->nr_var = 0;
+    s->var_name = NULL;
+    s->var_vn = NULL;
+    s->nr_expr = 0;
+    s->expr = NULL;
+    return s;
+}
+
+VNState *copy_vn_state(VNState *s) {
+    VNState *c = newVNState();
+    memcpy(c->temp_vn, s->temp_vn, (nr_state_temp + 1) * sizeof(int));
+    c->nr_var = s->nr_var;
+    c->var_name = malloc(s->nr_var * sizeof(char *) + 1);
+    memcpy(c->var_name, s->var_name, s->nr_var * sizeof(char *));
+    c->var_vn = malloc(s->nr_var * sizeof(int) + 1);
+    memcpy(c->var_vn, s->var_vn, s->nr_var * sizeof(int));
+    c->nr_expr = s->nr_expr;
+    c->expr = malloc(s->nr_expr * sizeof(Expr) + 1);
+    memcpy(c->expr, s->expr, s->nr_expr * sizeof(Expr));
+    return c;
+}
+
+static int const_vn(int kind, int value) {
+    for (int i = 0; i < nr_const; i++) {
+        if (consts[i].kind == kind && consts[i].value == value) {
+            return consts[i].vn;
+        }
+    }
+    consts = realloc(consts, (nr_const + 1) * sizeof(Const));
+    consts[nr_const].kind = kind;
+    consts[nr_const].value = value;
+    consts[nr_const].vn = ++nr_vn;
+    return consts[nr_const++].vn;
+}
+
+static int *var_slot(VNState *s, char *name) {
+    for (int i = 0; i < s->nr_var; i++) {
+        if (strcmp(s->var_name[i], name) == 0) {
+            return &s->var_vn[i];
+        }
+    }
+    s->var_name = realloc(s->var_name, (s->nr_var + 1) * sizeof(char *));
+    s->var_vn = realloc(s->var_vn, (s->nr_var + 1) * sizeof(int));
+    s->var_name[s->nr_var] = name;
+    s->var_vn[s->nr_var] = 0;
+    return &s->var_vn[s->nr_var++];
+}
+
+static int *vn_slot(VNState *s, Operand *op) {
+    if (op->kind == TEMP && op->temp_no <= nr_state_temp) {
+        return &s->temp_vn[op->temp_no];
+    } else if (op->kind == VAR_OPERAND) {
+        return var_slot(s, op->var_name);
+    } else {
+        return NULL;
+    }
+}
+
+// a loaded value gets a fresh number on every use
+int vn_of(VNState *s, Operand *op) {
+    if (op->kind == INT_LITERAL) {
+        return const_vn(INT_LITERAL, op->int_value);
+    } else if (op->kind == ADDR && op->addr_var->kind == TEMP) {
+        return const_vn(ADDR, op->addr_var->temp_no);
+    }
+    int *slot = vn_slot(s, op);
+    if (slot == NULL) {
+        return ++nr_vn;
+    }
+    if (*slot == 0) {
+        *slot = ++nr_vn;
+    }
+    return *slot;
+}
+
+static int expr_vn(VNState *s, int kind, int vn1, int vn2) {
+    if ((kind == IR_ADD || kind == IR_MUL) && vn1 > vn2) {
+        int t = vn1;
+        vn1 = vn2;
+        vn2 = t;
+    }
+    for (int i = 0; i < s->nr_expr; i++) {
+        Expr *e = &s->expr[i];
+        if (e->kind == kind && e->vn1 == vn1 && e->vn2 == vn2) {
+            return e->vn;
+        }
+    }
+    s->expr = realloc(s->expr, (s->nr_expr + 1) * sizeof(Expr));
+    s->expr[s->nr_expr].kind = kind;
+    s->expr[s->nr_expr].vn1 = vn1;
+    s->expr[s->nr_expr].vn2 = vn2;
+    s->expr[s->nr_expr].vn = ++nr_vn;
+    return s->expr[s->nr_expr++].vn;
+}
+
+static int def_vn(VNState *s, IR *ir) {
+    if (ir->kind == IR_ASSIGN) {
+        return vn_of(s, ir->arg1);
+    } else if (ir->kind == IR_ADD
+            || ir->kind == IR_SUB
+            || ir->kind == IR_MUL
+            || ir->kind == IR_DIV) {
+        if (ir->arg1->kind == INDIR || ir->arg2->kind == INDIR) {
+            return ++nr_vn;
+        }
+        return expr_vn(s, ir->kind, vn_of(s, ir->arg1), vn_of(s, ir->arg2));
+    } else if (ir->kind == IR_CMP) {
+        if (ir->arg1->kind == INDIR || ir->arg2->kind == INDIR) {
+            return ++nr_vn;
+        }
+        // relops do not collide with the IR kinds
+        return expr_vn(s, ir->relop, vn_of(s, ir->arg1), vn_of(s, ir->arg2));
+    } else {
+        return ++nr_vn;
+    }
+}
+
+// number the value defined by ir, returns 0 if none
+int vn_update(VNState *s, IR *ir) {
+    int vn = 0;
+    Operand *def = ir_def(ir);
+    if (def != NULL) {
+        vn = def_vn(s, ir);
+        int *slot = vn_slot(s, def);
+        if (slot != NULL) {
+            *slot = vn;
+        } else {
+            vn = 0;
+        }
+    }
+    if (ir->kind == IR_CALL) {
+        // the callee may assign global variables
+        for (int i = 0; i < s->nr_var; i++) {
+            if (call_may_modify(ir, s->var_name[i])) {
+                s->var_vn[i] = 0;
+            }
+        }
+        if (def != NULL && def->kind == VAR_OPERAND) {
+            *var_slot(s, def->var_name) = vn;
+        }
+    }
+    return vn;
+}
@@ -0,0 +1,16 @@
+#ifndef __VN_H__
+#define __VN_H__
+
+#include "common.h"
+#include "ir.h"
+
+// local value numbering: equal numbers mean equal values
+typedef struct VNState_ VNState;
+
+void vn_init();
+VNState *newVNState();
+VNState *copy_vn_state(VNState *s);
+int vn_of(VNState *s, Operand *op);
+int vn_update(VNState *s, IR *ir);
+
+#endif